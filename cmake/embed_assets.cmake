@@ -0,0 +1,44 @@
+# Writes OUTPUT, a header holding every file in ASSETS (comma separated, relative to
+# SOURCE_DIR) and in GENERATED (build outputs, relative to GENERATED_DIR) as a constexpr
+# byte array, plus a table to look them up by name. Arrays are 16-byte aligned so binary
+# formats can be read in place.
+
+string(REPLACE "," ";" ASSETS "${ASSETS}")
+string(REPLACE "," ";" GENERATED "${GENERATED}")
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+macro(embed ROOT ASSET)
+  file(READ ${ROOT}/${ASSET} BYTES HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${BYTES}")
+  string(REGEX REPLACE "(0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,)" "\\1\n  " BYTES "${BYTES}")
+  string(APPEND ARRAYS "// ${ASSET}\nalignas(16) constexpr unsigned char EMBEDDED_ASSET_${INDEX}[] {\n  ${BYTES}\n};\n\n")
+  string(APPEND TABLE "  {\"${ASSET}\", EMBEDDED_ASSET_${INDEX}, sizeof(EMBEDDED_ASSET_${INDEX})},\n")
+  math(EXPR INDEX "${INDEX} + 1")
+endmacro()
+foreach(ASSET ${ASSETS})
+  embed(${SOURCE_DIR} ${ASSET})
+endforeach()
+foreach(ASSET ${GENERATED})
+  embed(${GENERATED_DIR} ${ASSET})
+endforeach()
+
+file(WRITE ${OUTPUT}
+"// generated by cmake/embed_assets.cmake, do not edit
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <cstddef>
+
+struct EmbeddedAsset {
+  const char* name;
+  const unsigned char* data;
+  std::size_t size;
+};
+
+${ARRAYS}constexpr EmbeddedAsset EMBEDDED_ASSETS[] {
+${TABLE}};
+
+#endif
+")
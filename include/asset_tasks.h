@@ -0,0 +1,509 @@
+#ifndef ASSET_TASKS_H
+#define ASSET_TASKS_H
+
+#include <assets.h>
+#include <job_pool.h>
+
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <utility>
+#include <exception>
+#include <type_traits>
+#include <algorithm>
+
+// Cancelling stops every task spawned with the token at its next hop between threads.
+class CancellationToken {
+private:
+  std::shared_ptr<std::atomic<bool>> flag {std::make_shared<std::atomic<bool>>(false)};
+public:
+  void cancel() const;
+  bool cancelled() const;
+};
+
+void CancellationToken::cancel() const {
+  *flag = true;
+}
+
+bool CancellationToken::cancelled() const {
+  return *flag;
+}
+
+namespace asset_tasks_detail {
+  struct TaskContext;
+
+  // a suspended coroutine waiting for its turn on the pool or the GL thread
+  struct Scheduled {
+    int priority;
+    uint64_t sequence;
+    std::shared_ptr<TaskContext> context;
+    std::function<void()> resume;
+  };
+
+  // heap order: highest priority first, oldest first among equals
+  inline bool runs_later(const Scheduled &a, const Scheduled &b) {
+    return a.priority < b.priority || (a.priority == b.priority && a.sequence > b.sequence);
+  }
+
+  // shared with the pool jobs, which may run after AssetTasks is gone
+  struct Queues : std::enable_shared_from_this<Queues> {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Scheduled> pool;
+    std::vector<Scheduled> gl_thread;
+    uint64_t sequence {0};
+    unsigned int running {0}; // pool jobs inside a coroutine
+    bool stopping {false};
+    size_t cancelled {0};
+
+    void schedule(bool on_gl_thread, std::shared_ptr<TaskContext> context, std::function<void()> resume);
+    // pops the next coroutine of `queue`, false when it is empty; the lock must be held
+    bool pop(std::vector<Scheduled> &queue, Scheduled &scheduled);
+    void run(Scheduled scheduled);
+    void run_pool_job();
+  };
+
+  // a task suspended in AssetTasks::after() until another one is done
+  struct Waiting {
+    std::shared_ptr<TaskContext> context;
+    std::function<void()> resume;
+  };
+
+  // one per spawned task, shared by every task it awaits
+  struct TaskContext {
+    std::atomic<int> priority;
+    CancellationToken token;
+    std::shared_ptr<Queues> queues;
+    std::coroutine_handle<> root;
+    std::atomic<bool> finished {false};
+    std::atomic<bool> cancelled {false};
+    std::vector<Waiting> waiting {}; // guarded by the queues' mutex
+
+    // marks the task done and queues the tasks waiting on it on the pool
+    void finish(bool was_cancelled);
+  };
+
+  template <typename T>
+  struct TaskResult {
+    std::optional<T> value;
+
+    void return_value(T result) { value = std::move(result); }
+    T take() { return std::move(*value); }
+  };
+
+  template <>
+  struct TaskResult<void> {
+    void return_void() {}
+    void take() {}
+  };
+}
+
+// A coroutine returning T. It starts when awaited, and its awaiter resumes on whichever
+// thread it finishes on. Only spawn() starts a task without an awaiter.
+template <typename T = void>
+class Task {
+public:
+  struct promise_type : asset_tasks_detail::TaskResult<T> {
+    std::shared_ptr<asset_tasks_detail::TaskContext> context;
+    std::coroutine_handle<> continuation;
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+      void await_resume() noexcept {}
+    };
+
+    Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    // nothing in the loaders throws; an exception escaping a task is a bug
+    void unhandled_exception() { std::terminate(); }
+  };
+private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit Task(std::coroutine_handle<promise_type> handle);
+  friend class AssetTasks;
+public:
+  Task(Task &&other) noexcept;
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task();
+
+  bool await_ready() const noexcept { return false; }
+  template <typename Promise>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiting) noexcept;
+  T await_resume();
+};
+
+// Watches a spawned task from outside; cancel() cancels its whole token.
+class TaskHandle {
+private:
+  std::shared_ptr<asset_tasks_detail::TaskContext> context;
+
+  friend class AssetTasks;
+public:
+  TaskHandle() = default;
+  explicit TaskHandle(std::shared_ptr<asset_tasks_detail::TaskContext> context);
+
+  // both do nothing on a handle no task was spawned into
+  void cancel() const;
+  // used from the task's next hop on; higher runs first
+  void set_priority(int priority) const;
+
+  bool finished() const;  // ran to its end
+  bool cancelled() const; // destroyed at a hop after cancel()
+  bool done() const;
+};
+
+// Runs asset loading written as straight-line coroutines across threads: reads and
+// decodes on the job pool, uploads on the GL thread, which hands its queue a time slice
+// with run_gl_thread() each frame. Each hop queues the coroutine by its task's priority.
+// A task whose token is cancelled is not resumed at its next hop; its frame is destroyed
+// with the frames of every task it awaits, so locals are released as on a normal return.
+//
+//   Task<> load(AssetTasks &tasks, std::string name) {
+//     Asset bytes = co_await tasks.read(name);                                // on the pool
+//     DecodedImage image = co_await tasks.on_pool([&]() { return decode(bytes); });
+//     co_await tasks.on_gl_thread([&]() { upload(image); });                  // on the GL thread
+//   }
+//
+// A task waits for another spawned one with `co_await tasks.after(handle)`, which parks it
+// without holding a worker.
+class AssetTasks {
+private:
+  std::shared_ptr<asset_tasks_detail::Queues> queues {std::make_shared<asset_tasks_detail::Queues>()};
+
+  template <typename Work>
+  class ScheduledWork {
+  private:
+    using Result = std::invoke_result_t<Work&>;
+    std::shared_ptr<asset_tasks_detail::Queues> queues;
+    bool on_gl_thread;
+    Work work;
+    std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>> result;
+  public:
+    ScheduledWork(std::shared_ptr<asset_tasks_detail::Queues> queues, bool on_gl_thread, Work work);
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle);
+    Result await_resume();
+  };
+  class Joined {
+  private:
+    std::shared_ptr<asset_tasks_detail::TaskContext> task;
+  public:
+    explicit Joined(std::shared_ptr<asset_tasks_detail::TaskContext> task);
+
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> handle);
+    void await_resume() {}
+  };
+  struct ReadAsset {
+    const std::string* name;
+
+    Asset operator()() const { return assets.get(*name); }
+  };
+public:
+  AssetTasks() = default;
+  AssetTasks(const AssetTasks&) = delete;
+  AssetTasks& operator=(const AssetTasks&) = delete;
+  // waits for coroutines running on the pool, then destroys every task still queued
+  ~AssetTasks();
+
+  TaskHandle spawn(Task<> task, int priority = 0, CancellationToken token = {});
+
+  // awaitables: `work()` runs on a pool worker or on the GL thread, the task continues
+  // there with its result
+  template <typename Work>
+  ScheduledWork<Work> on_pool(Work work);
+  template <typename Work>
+  ScheduledWork<Work> on_gl_thread(Work work);
+  // the asset's bytes, read on the pool through the virtual filesystem
+  Task<Asset> read(std::string name);
+  // awaitable: continues on the pool once `task`, spawned on these tasks, has finished or
+  // was cancelled, and right away when it already is or no task was spawned into it
+  Joined after(const TaskHandle &task);
+
+  // resumes queued GL thread work for up to `microseconds`, at least one coroutine
+  void run_gl_thread(double microseconds = 2000.0);
+  // runs GL thread work until `task` is done; call on the GL thread
+  void wait(const TaskHandle &task);
+
+  size_t cancelled() const;
+};
+
+void asset_tasks_detail::Queues::schedule(bool on_gl_thread, std::shared_ptr<TaskContext> context, std::function<void()> resume) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Scheduled>& queue = on_gl_thread ? gl_thread : pool;
+    int priority = context->priority;
+    queue.push_back({priority, sequence++, std::move(context), std::move(resume)});
+    std::push_heap(queue.begin(), queue.end(), runs_later);
+  }
+  if (on_gl_thread) {
+    changed.notify_all();
+    return;
+  }
+  // a job runs whichever coroutine is first when it starts, not the one queued with it
+  job_pool.submit([queues = shared_from_this()]() { queues->run_pool_job(); });
+}
+
+bool asset_tasks_detail::Queues::pop(std::vector<Scheduled> &queue, Scheduled &scheduled) {
+  if (queue.empty()) {
+    return false;
+  }
+  std::pop_heap(queue.begin(), queue.end(), runs_later);
+  scheduled = std::move(queue.back());
+  queue.pop_back();
+  return true;
+}
+
+void asset_tasks_detail::Queues::run(Scheduled scheduled) {
+  if (!scheduled.context->token.cancelled()) {
+    scheduled.resume();
+    return;
+  }
+  // the spawned frame owns the tasks it awaits, destroying it destroys the whole chain
+  scheduled.context->root.destroy();
+  scheduled.context->finish(true);
+}
+
+void asset_tasks_detail::Queues::run_pool_job() {
+  Scheduled scheduled;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping || !pop(pool, scheduled)) {
+      return;
+    }
+    running++;
+  }
+  run(std::move(scheduled));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running--;
+  }
+  changed.notify_all();
+}
+
+void asset_tasks_detail::TaskContext::finish(bool was_cancelled) {
+  std::vector<Waiting> resumed;
+  {
+    std::lock_guard<std::mutex> lock(queues->mutex);
+    (was_cancelled ? cancelled : finished) = true;
+    queues->cancelled += was_cancelled;
+    resumed.swap(waiting);
+  }
+  queues->changed.notify_all();
+  for (Waiting& waiter : resumed) {
+    queues->schedule(false, std::move(waiter.context), std::move(waiter.resume));
+  }
+}
+
+template <typename T>
+std::coroutine_handle<> Task<T>::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+  promise_type& promise = handle.promise();
+  if (promise.continuation) {
+    return promise.continuation;
+  }
+  // a spawned task has no awaiter to destroy its frame, it goes by itself
+  std::shared_ptr<asset_tasks_detail::TaskContext> context = std::move(promise.context);
+  handle.destroy();
+  context->finish(false);
+  return std::noop_coroutine();
+}
+
+template <typename T>
+Task<T>::Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+template <typename T>
+Task<T>::Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+template <typename T>
+Task<T>::~Task() {
+  if (handle) {
+    handle.destroy();
+  }
+}
+
+template <typename T>
+template <typename Promise>
+std::coroutine_handle<> Task<T>::await_suspend(std::coroutine_handle<Promise> awaiting) noexcept {
+  // the awaited task runs under the awaiting one's priority and token
+  handle.promise().context = awaiting.promise().context;
+  handle.promise().continuation = awaiting;
+  return handle;
+}
+
+template <typename T>
+T Task<T>::await_resume() {
+  return handle.promise().take();
+}
+
+TaskHandle::TaskHandle(std::shared_ptr<asset_tasks_detail::TaskContext> context) : context(std::move(context)) {}
+
+void TaskHandle::cancel() const {
+  if (context) {
+    context->token.cancel();
+  }
+}
+
+void TaskHandle::set_priority(int priority) const {
+  if (context) {
+    context->priority = priority;
+  }
+}
+
+bool TaskHandle::finished() const {
+  return context && context->finished;
+}
+
+bool TaskHandle::cancelled() const {
+  return context && context->cancelled;
+}
+
+bool TaskHandle::done() const {
+  return finished() || cancelled();
+}
+
+template <typename Work>
+AssetTasks::ScheduledWork<Work>::ScheduledWork(std::shared_ptr<asset_tasks_detail::Queues> queues, bool on_gl_thread, Work work)
+  : queues(std::move(queues)), on_gl_thread(on_gl_thread), work(std::move(work)) {}
+
+template <typename Work>
+template <typename Promise>
+void AssetTasks::ScheduledWork<Work>::await_suspend(std::coroutine_handle<Promise> handle) {
+  // the coroutine may be resumed on another thread before schedule() returns, nothing
+  // here touches the awaiter afterwards
+  queues->schedule(on_gl_thread, handle.promise().context, [this, handle]() {
+    if constexpr (std::is_void_v<Result>) {
+      work();
+    }
+    else {
+      result.emplace(work());
+    }
+    handle.resume();
+  });
+}
+
+template <typename Work>
+typename AssetTasks::ScheduledWork<Work>::Result AssetTasks::ScheduledWork<Work>::await_resume() {
+  if constexpr (!std::is_void_v<Result>) {
+    return std::move(*result);
+  }
+}
+
+AssetTasks::~AssetTasks() {
+  std::unique_lock<std::mutex> lock(queues->mutex);
+  queues->stopping = true;
+  queues->changed.wait(lock, [&]() { return queues->running == 0; });
+  // finishing an abandoned task queues the ones waiting on it, which go in the next round
+  while (!queues->pool.empty() || !queues->gl_thread.empty()) {
+    std::vector<asset_tasks_detail::Scheduled> abandoned = std::move(queues->pool);
+    abandoned.insert(abandoned.end(), std::make_move_iterator(queues->gl_thread.begin()), std::make_move_iterator(queues->gl_thread.end()));
+    queues->pool.clear();
+    queues->gl_thread.clear();
+    lock.unlock();
+    for (asset_tasks_detail::Scheduled& scheduled : abandoned) {
+      scheduled.context->root.destroy();
+      scheduled.context->finish(true);
+    }
+    lock.lock();
+  }
+}
+
+TaskHandle AssetTasks::spawn(Task<> task, int priority, CancellationToken token) {
+  auto context = std::make_shared<asset_tasks_detail::TaskContext>();
+  context->priority = priority;
+  context->token = std::move(token);
+  context->queues = queues;
+  context->root = task.handle;
+  task.handle.promise().context = context;
+  std::coroutine_handle<> root = std::exchange(task.handle, {});
+  queues->schedule(false, context, [root]() { root.resume(); });
+  return TaskHandle(context);
+}
+
+template <typename Work>
+AssetTasks::ScheduledWork<Work> AssetTasks::on_pool(Work work) {
+  return ScheduledWork<Work>(queues, false, std::move(work));
+}
+
+template <typename Work>
+AssetTasks::ScheduledWork<Work> AssetTasks::on_gl_thread(Work work) {
+  return ScheduledWork<Work>(queues, true, std::move(work));
+}
+
+Task<Asset> AssetTasks::read(std::string name) {
+  // a named function object, a lambda's type in the frame of a non-template coroutine
+  // would have no linkage; it points at `name`, which lives in the frame
+  Asset asset = co_await on_pool(ReadAsset {&name});
+  co_return asset;
+}
+
+AssetTasks::Joined::Joined(std::shared_ptr<asset_tasks_detail::TaskContext> task) : task(std::move(task)) {}
+
+template <typename Promise>
+bool AssetTasks::Joined::await_suspend(std::coroutine_handle<Promise> handle) {
+  if (!task) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(task->queues->mutex);
+  if (task->finished || task->cancelled) {
+    return false;
+  }
+  task->waiting.push_back({handle.promise().context, [handle]() { handle.resume(); }});
+  return true;
+}
+
+AssetTasks::Joined AssetTasks::after(const TaskHandle &task) {
+  return Joined(task.context);
+}
+
+void AssetTasks::run_gl_thread(double microseconds) {
+  auto start = std::chrono::steady_clock::now();
+  asset_tasks_detail::Scheduled scheduled;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(queues->mutex);
+      if (!queues->pop(queues->gl_thread, scheduled)) {
+        return;
+      }
+    }
+    queues->run(std::move(scheduled));
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed.count() >= microseconds) {
+      return;
+    }
+  }
+}
+
+void AssetTasks::wait(const TaskHandle &task) {
+  while (true) {
+    asset_tasks_detail::Scheduled scheduled;
+    {
+      std::unique_lock<std::mutex> lock(queues->mutex);
+      queues->changed.wait(lock, [&]() { return task.done() || !queues->gl_thread.empty(); });
+      if (task.done() || !queues->pop(queues->gl_thread, scheduled)) {
+        return;
+      }
+    }
+    queues->run(std::move(scheduled));
+  }
+}
+
+size_t AssetTasks::cancelled() const {
+  std::lock_guard<std::mutex> lock(queues->mutex);
+  return queues->cancelled;
+}
+
+#endif
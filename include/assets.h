@@ -0,0 +1,96 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#ifdef EMBED_ASSETS
+#include <embedded_assets.h>
+#endif
+
+#include <virtual_filesystem.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
+#include <iostream>
+
+struct Asset {
+  const unsigned char* data {nullptr};
+  size_t size {0};
+
+  std::string_view text() const { return std::string_view((const char*)data, size); }
+};
+
+// Core assets are compiled into the binary and mounted at the lowest priority. Setting
+// ASSET_DIR (or building without EMBED_ASSETS) mounts a directory over them, so shaders
+// can be edited without rebuilding, and ASSET_PACK mounts a pack built by the `packer`
+// target over both. More mounts can be added through filesystem().
+class Assets {
+private:
+  VirtualFilesystem vfs;
+public:
+  Assets();
+
+  // `name` is relative to the repository root, e.g. "textures/container.jpg"
+  Asset get(const std::string &name);
+
+  // reads every file not loaded yet in one concurrent batch, so later get()s are memory
+  // lookups; returns how many were read, none when everything is embedded
+  size_t preload(AsyncReader &reader, const std::vector<std::string> &names);
+
+  // where `name` is read from on disk, empty when it comes from the binary or a pack
+  std::string file_path(const std::string &name);
+
+  VirtualFilesystem& filesystem();
+};
+
+inline Assets assets;
+
+Assets::Assets() {
+#ifdef EMBED_ASSETS
+  std::map<std::string, std::span<const unsigned char>> embedded;
+  for (const EmbeddedAsset& asset : EMBEDDED_ASSETS) {
+    embedded.emplace(asset.name, std::span<const unsigned char>(asset.data, asset.size));
+  }
+  vfs.mount_memory(embedded, "", 0);
+#else
+  vfs.mount_directory(ASSET_ROOT, "", 0);
+#endif
+  const char* asset_dir = std::getenv("ASSET_DIR");
+  if (asset_dir) {
+    vfs.mount_directory(asset_dir, "", 10);
+  }
+  const char* asset_pack = std::getenv("ASSET_PACK");
+  if (asset_pack) {
+    vfs.mount_pack(asset_pack, "", 20);
+  }
+}
+
+Asset Assets::get(const std::string &name) {
+  std::span<const unsigned char> bytes = vfs.read(vfs.intern(name));
+  if (bytes.data() == nullptr) {
+    std::cout << "ERROR::ASSETS::FILE_NOT_SUCCESSFULLY_READ " << name << std::endl;
+    return {};
+  }
+  return {bytes.data(), bytes.size()};
+}
+
+size_t Assets::preload(AsyncReader &reader, const std::vector<std::string> &names) {
+  std::vector<VirtualFilesystem::PathId> ids;
+  for (const std::string& name : names) {
+    ids.push_back(vfs.intern(name));
+  }
+  return vfs.preload(reader, ids);
+}
+
+std::string Assets::file_path(const std::string &name) {
+  return vfs.disk_path(vfs.intern(name));
+}
+
+VirtualFilesystem& Assets::filesystem() {
+  return vfs;
+}
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include <job_pool.h>
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+// <linux/fs.h>, included by io_uring.h, defines a BLOCK_SIZE macro nothing here uses
+#undef BLOCK_SIZE
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+
+// Reads a batch of whole files concurrently instead of one blocking read at a time. Each
+// file is opened and sized up front, its buffer allocated once, and the reads are all
+// submitted to an io_uring so the disk sees the whole batch; where io_uring is missing
+// or refused, up to `threads` job pool workers and the calling thread issue pread()s
+// instead. `complete(index, ok)` runs on the calling thread as each file lands, so
+// decoding can start before the batch ends.
+class AsyncReader {
+private:
+  struct File {
+    int descriptor {-1};
+    size_t done {0};
+    iovec vector {};
+  };
+  unsigned int queue_depth;
+  unsigned int threads;
+
+  // io_uring, set up by hand: the submission and completion rings plus the SQE array
+  int ring {-1};
+  void* submission_ring {MAP_FAILED};
+  void* completion_ring {MAP_FAILED};
+  size_t submission_ring_size {0};
+  size_t completion_ring_size {0};
+  io_uring_sqe* entries {(io_uring_sqe*)MAP_FAILED};
+  unsigned int entry_count {0};
+  unsigned int* submission_head;
+  unsigned int* submission_tail;
+  unsigned int* submission_mask;
+  unsigned int* submission_array;
+  unsigned int* completion_head;
+  unsigned int* completion_tail;
+  unsigned int* completion_mask;
+  io_uring_cqe* completions;
+
+  bool setup_ring();
+  void submit(File &file, size_t size, unsigned long index);
+
+  template <typename Complete>
+  void read_ring(std::vector<File> &files, std::vector<std::vector<unsigned char>> &buffers, Complete &complete);
+  template <typename Complete>
+  void read_threads(std::vector<File> &files, std::vector<std::vector<unsigned char>> &buffers, Complete &complete);
+public:
+  AsyncReader(unsigned int queue_depth = 64, unsigned int threads = 4);
+  AsyncReader(const AsyncReader&) = delete;
+  AsyncReader& operator=(const AsyncReader&) = delete;
+  ~AsyncReader();
+
+  // fills `buffers[i]` with the contents of `paths[i]`; returns how many files were read
+  template <typename Complete>
+  size_t read(const std::vector<std::string> &paths, std::vector<std::vector<unsigned char>> &buffers, Complete complete);
+
+  bool using_io_uring() const;
+};
+
+AsyncReader::AsyncReader(unsigned int queue_depth, unsigned int threads)
+  : queue_depth(std::max(queue_depth, 1u)), threads(std::max(threads, 1u)) {
+  if (!setup_ring() && ring != -1) {
+    close(ring);
+    ring = -1;
+  }
+}
+
+AsyncReader::~AsyncReader() {
+  if (entries != MAP_FAILED) {
+    munmap(entries, entry_count * sizeof(io_uring_sqe));
+  }
+  if (completion_ring != MAP_FAILED && completion_ring != submission_ring) {
+    munmap(completion_ring, completion_ring_size);
+  }
+  if (submission_ring != MAP_FAILED) {
+    munmap(submission_ring, submission_ring_size);
+  }
+  if (ring != -1) {
+    close(ring);
+  }
+}
+
+bool AsyncReader::setup_ring() {
+  io_uring_params parameters {};
+  ring = syscall(__NR_io_uring_setup, queue_depth, &parameters);
+  if (ring < 0) {
+    ring = -1;
+    return false;
+  }
+
+  submission_ring_size = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned int);
+  completion_ring_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+  // newer kernels map both rings with a single mmap
+  bool single_mmap = parameters.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    submission_ring_size = completion_ring_size = std::max(submission_ring_size, completion_ring_size);
+  }
+  submission_ring = mmap(NULL, submission_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+  if (submission_ring == MAP_FAILED) {
+    return false;
+  }
+  completion_ring = single_mmap ? submission_ring
+                                : mmap(NULL, completion_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+  if (completion_ring == MAP_FAILED) {
+    return false;
+  }
+  entry_count = parameters.sq_entries;
+  entries = (io_uring_sqe*)mmap(NULL, entry_count * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+  if (entries == MAP_FAILED) {
+    return false;
+  }
+
+  char* submission = (char*)submission_ring;
+  char* completion = (char*)completion_ring;
+  submission_head = (unsigned int*)(submission + parameters.sq_off.head);
+  submission_tail = (unsigned int*)(submission + parameters.sq_off.tail);
+  submission_mask = (unsigned int*)(submission + parameters.sq_off.ring_mask);
+  submission_array = (unsigned int*)(submission + parameters.sq_off.array);
+  completion_head = (unsigned int*)(completion + parameters.cq_off.head);
+  completion_tail = (unsigned int*)(completion + parameters.cq_off.tail);
+  completion_mask = (unsigned int*)(completion + parameters.cq_off.ring_mask);
+  completions = (io_uring_cqe*)(completion + parameters.cq_off.cqes);
+  return true;
+}
+
+void AsyncReader::submit(File &file, size_t size, unsigned long index) {
+  // single producer: only this thread writes the tail, the kernel moves the head
+  unsigned int tail = *submission_tail;
+  unsigned int slot = tail & *submission_mask;
+  io_uring_sqe& entry = entries[slot];
+  std::fill_n((char*)&entry, sizeof(entry), 0);
+  entry.opcode = IORING_OP_READV;
+  entry.fd = file.descriptor;
+  entry.off = file.done;
+  entry.addr = (unsigned long)&file.vector;
+  entry.len = 1;
+  entry.user_data = index;
+  file.vector.iov_len = size - file.done;
+  submission_array[slot] = slot;
+  __atomic_store_n(submission_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+template <typename Complete>
+void AsyncReader::read_ring(std::vector<File> &files, std::vector<std::vector<unsigned char>> &buffers, Complete &complete) {
+  size_t next = 0;
+  unsigned int in_flight = 0;      // taken by the kernel, completion not seen yet
+  std::vector<size_t> short_reads; // their rest goes out with the next submission
+  // set once io_uring_enter refuses: nothing new is submitted, but the loop goes on until
+  // every read in flight has completed, the kernel may write into `buffers` until then
+  bool failed = false;
+  while (true) {
+    if (!failed) {
+      for (size_t index : short_reads) {
+        files[index].vector.iov_base = buffers[index].data() + files[index].done;
+        submit(files[index], buffers[index].size(), index);
+      }
+      short_reads.clear();
+      // keep the ring full
+      for (; next < files.size() && in_flight + (*submission_tail - __atomic_load_n(submission_head, __ATOMIC_ACQUIRE)) < entry_count; next++) {
+        if (files[next].descriptor == -1) {
+          continue;
+        }
+        files[next].vector.iov_base = buffers[next].data();
+        submit(files[next], buffers[next].size(), next);
+      }
+    }
+    unsigned int queued = *submission_tail - __atomic_load_n(submission_head, __ATOMIC_ACQUIRE);
+    if (in_flight + queued == 0) {
+      break;
+    }
+
+    // submit everything queued and wait for at least one read; the kernel's head says how
+    // many entries it took, whatever the result
+    int result = syscall(__NR_io_uring_enter, ring, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    int error = result < 0 ? errno : 0;
+    unsigned int left = *submission_tail - __atomic_load_n(submission_head, __ATOMIC_ACQUIRE);
+    in_flight += queued - left;
+    bool retry = error == EINTR || ((error == EAGAIN || error == EBUSY) && in_flight > 0);
+    if (result < 0 && !retry) {
+      if (failed) {
+        // cannot even wait any more; nothing else can be done about the reads still out
+        std::cout << "ERROR::ASYNC_READER::IO_URING_WAIT" << std::endl;
+        break;
+      }
+      std::cout << "ERROR::ASYNC_READER::IO_URING_ENTER" << std::endl;
+      failed = true;
+      // entries the kernel never took are taken back, their files are reported below
+      __atomic_store_n(submission_tail, *submission_tail - left, __ATOMIC_RELEASE);
+    }
+
+    unsigned int head = *completion_head;
+    unsigned int tail = __atomic_load_n(completion_tail, __ATOMIC_ACQUIRE);
+    std::vector<std::pair<size_t, bool>> finished;
+    for (; head != tail; head++) {
+      const io_uring_cqe& entry = completions[head & *completion_mask];
+      size_t index = entry.user_data;
+      File& file = files[index];
+      in_flight--;
+      if (entry.res > 0) {
+        file.done += entry.res;
+        if (file.done < buffers[index].size() && !failed) {
+          short_reads.push_back(index);
+          continue;
+        }
+      }
+      close(file.descriptor);
+      file.descriptor = -1;
+      finished.emplace_back(index, entry.res >= 0 && file.done == buffers[index].size());
+    }
+    __atomic_store_n(completion_head, head, __ATOMIC_RELEASE);
+    for (auto [index, ok] : finished) {
+      complete(index, ok);
+    }
+  }
+
+  // only after a failed io_uring_enter, with no read in flight: the files not read are
+  // reported as failed
+  for (size_t index = 0; index < files.size(); index++) {
+    if (files[index].descriptor != -1) {
+      close(files[index].descriptor);
+      files[index].descriptor = -1;
+      complete(index, false);
+    }
+  }
+}
+
+template <typename Complete>
+void AsyncReader::read_threads(std::vector<File> &files, std::vector<std::vector<unsigned char>> &buffers, Complete &complete) {
+  // shared with the pool jobs, so one starting after every file is claimed leaves without
+  // touching the batch
+  struct Progress {
+    std::atomic<size_t> next {0};
+    std::mutex mutex;
+    std::condition_variable finished_changed;
+    std::deque<std::pair<size_t, bool>> finished;
+  };
+  auto progress = std::make_shared<Progress>();
+  size_t count = files.size();
+  size_t expected = std::count_if(files.begin(), files.end(), [](const File& file) { return file.descriptor != -1; });
+
+  // claims the next file and reads it; false once every file is claimed
+  auto read_next = [progress, count, &files, &buffers]() {
+    size_t index = progress->next++;
+    if (index >= count) {
+      return false;
+    }
+    File& file = files[index];
+    if (file.descriptor == -1) {
+      return true;
+    }
+    ssize_t result = 1;
+    while (file.done < buffers[index].size() && result > 0) {
+      result = pread(file.descriptor, buffers[index].data() + file.done, buffers[index].size() - file.done, file.done);
+      file.done += std::max<ssize_t>(result, 0);
+    }
+    close(file.descriptor);
+    std::lock_guard<std::mutex> lock(progress->mutex);
+    progress->finished.emplace_back(index, file.done == buffers[index].size());
+    progress->finished_changed.notify_one();
+    return true;
+  };
+  for (size_t i = 1; i < std::min<size_t>(threads, expected); i++) {
+    job_pool.submit([read_next]() {
+      while (read_next()) {}
+    });
+  }
+
+  for (size_t reported = 0; reported < expected;) {
+    std::unique_lock<std::mutex> lock(progress->mutex);
+    if (progress->finished.empty()) {
+      // nothing landed yet: read here rather than wait, so a busy pool never stalls the batch
+      lock.unlock();
+      if (read_next()) {
+        continue;
+      }
+      lock.lock();
+      progress->finished_changed.wait(lock, [&]() { return !progress->finished.empty(); });
+    }
+    auto [index, ok] = progress->finished.front();
+    progress->finished.pop_front();
+    lock.unlock();
+    complete(index, ok);
+    reported++;
+  }
+  for (File& file : files) {
+    file.descriptor = -1;
+  }
+}
+
+template <typename Complete>
+size_t AsyncReader::read(const std::vector<std::string> &paths, std::vector<std::vector<unsigned char>> &buffers, Complete complete) {
+  std::vector<File> files(paths.size());
+  buffers.resize(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    struct stat status;
+    int descriptor = open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1 || fstat(descriptor, &status) == -1) {
+      std::cout << "ERROR::ASYNC_READER::FILE_NOT_SUCCESSFULLY_READ " << paths[i] << std::endl;
+      if (descriptor != -1) {
+        close(descriptor);
+      }
+      complete(i, false);
+      continue;
+    }
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    files[i].descriptor = descriptor;
+    buffers[i].resize(status.st_size);
+  }
+
+  size_t read = 0;
+  auto counted = [&](size_t index, bool ok) {
+    read += ok;
+    complete(index, ok);
+  };
+  if (ring != -1) {
+    read_ring(files, buffers, counted);
+  }
+  else {
+    read_threads(files, buffers, counted);
+  }
+  return read;
+}
+
+bool AsyncReader::using_io_uring() const {
+  return ring != -1;
+}
+
+#endif
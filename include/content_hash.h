@@ -0,0 +1,85 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// XXH64 (xxHash, 64-bit variant): fast enough to hash whole asset files at load.
+uint64_t content_hash(const void* data, size_t size, uint64_t seed = 0);
+
+namespace content_hash_detail {
+  const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+  const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+  const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+  const uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+  const uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+  inline uint64_t rotate(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  inline uint64_t read_64(const unsigned char* bytes) {
+    uint64_t value;
+    std::memcpy(&value, bytes, 8);
+    return value;
+  }
+
+  inline uint32_t read_32(const unsigned char* bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    return value;
+  }
+
+  inline uint64_t round(uint64_t accumulator, uint64_t input) {
+    return rotate(accumulator + input * PRIME_2, 31) * PRIME_1;
+  }
+
+  inline uint64_t merge(uint64_t hash, uint64_t accumulator) {
+    return (hash ^ round(0, accumulator)) * PRIME_1 + PRIME_4;
+  }
+}
+
+uint64_t content_hash(const void* data, size_t size, uint64_t seed) {
+  using namespace content_hash_detail;
+  const unsigned char* bytes = (const unsigned char*)data;
+  const unsigned char* end = bytes + size;
+  uint64_t hash;
+
+  if (size >= 32) {
+    uint64_t lanes[4] {seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1};
+    for (; bytes + 32 <= end; bytes += 32) {
+      for (int lane = 0; lane < 4; lane++) {
+        lanes[lane] = round(lanes[lane], read_64(bytes + lane * 8));
+      }
+    }
+    hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+    for (uint64_t lane : lanes) {
+      hash = merge(hash, lane);
+    }
+  }
+  else {
+    hash = seed + PRIME_5;
+  }
+  hash += size;
+
+  for (; bytes + 8 <= end; bytes += 8) {
+    hash = rotate(hash ^ round(0, read_64(bytes)), 27) * PRIME_1 + PRIME_4;
+  }
+  if (bytes + 4 <= end) {
+    hash = rotate(hash ^ (read_32(bytes) * PRIME_1), 23) * PRIME_2 + PRIME_3;
+    bytes += 4;
+  }
+  for (; bytes < end; bytes++) {
+    hash = rotate(hash ^ (*bytes * PRIME_5), 11) * PRIME_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME_2;
+  hash ^= hash >> 29;
+  hash *= PRIME_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+#endif
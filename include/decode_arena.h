@@ -0,0 +1,197 @@
+#ifndef DECODE_ARENA_H
+#define DECODE_ARENA_H
+
+#include <vector>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Bump allocator behind stb_image's STBI_MALLOC/STBI_REALLOC/STBI_FREE. Frees are no-ops
+// and reset() rewinds everything once a decoded image has been copied out; the blocks are
+// kept, so after the first few images stb's zlib and scanline buffers cost no heap
+// allocation at all. Only stb's own traffic goes through here: the decoded pixels are
+// copied into the image's vector before the reset, and format conversion and the mip
+// chain allocate their own buffers, so each image still does a handful of allocations.
+// One arena per thread, so loader threads never contend; each publishes its statistics
+// on reset(), and total_statistics() adds up every thread's.
+class DecodeArena {
+private:
+  static constexpr size_t ALIGNMENT = 16;
+  static constexpr size_t BLOCK_SIZE = 4 * 1024 * 1024;
+  struct Block {
+    unsigned char* memory;
+    size_t size;
+    size_t used;
+  };
+  // every allocation is preceded by its size, which realloc needs to copy
+  struct Header {
+    size_t size;
+    size_t padding;
+  };
+  std::vector<Block> blocks;
+  size_t current {0};
+  unsigned char* last {nullptr};
+public:
+  struct Statistics {
+    size_t allocations {0};
+    size_t reallocations {0};
+    size_t in_place_reallocations {0};
+    size_t heap_allocations {0}; // blocks obtained from malloc
+    size_t resets {0};
+    size_t peak_bytes {0}; // in totals, the largest of any one arena
+    size_t arenas {0};     // only counted in totals
+  };
+private:
+  Statistics stats;
+  size_t in_use {0};
+
+  // what reset() has added to the totals so far; only the difference goes in each time,
+  // so the totals need no list of arenas and survive the threads that made them
+  Statistics published;
+  static std::mutex totals_mutex;
+  static Statistics totals;
+
+  // false when malloc fails
+  bool add_block(size_t minimum);
+  void publish();
+public:
+  DecodeArena() = default;
+  DecodeArena(const DecodeArena&) = delete;
+  DecodeArena& operator=(const DecodeArena&) = delete;
+  ~DecodeArena();
+
+  // nullptr when out of memory, which stb_image reports as a failed decode
+  void* allocate(size_t size);
+  void* reallocate(void* pointer, size_t size);
+  void release(void* pointer);
+
+  // invalidates everything allocated so far
+  void reset();
+
+  const Statistics& statistics() const;
+  // every thread's arena added up, as of their last reset()
+  static Statistics total_statistics();
+};
+
+inline std::mutex DecodeArena::totals_mutex;
+inline DecodeArena::Statistics DecodeArena::totals;
+
+inline thread_local DecodeArena decode_arena;
+
+DecodeArena::~DecodeArena() {
+  for (Block& block : blocks) {
+    std::free(block.memory);
+  }
+}
+
+bool DecodeArena::add_block(size_t minimum) {
+  size_t size = std::max(minimum, BLOCK_SIZE);
+  unsigned char* memory = (unsigned char*)std::malloc(size);
+  if (!memory) {
+    return false;
+  }
+  blocks.push_back({memory, size, 0});
+  current = blocks.size() - 1;
+  stats.heap_allocations++;
+  return true;
+}
+
+void* DecodeArena::allocate(size_t size) {
+  size_t needed = sizeof(Header) + (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  size_t first = current;
+  while (current < blocks.size() && blocks[current].size - blocks[current].used < needed) {
+    current++;
+  }
+  if (current == blocks.size() && !add_block(needed)) {
+    current = first; // `last` still lives there
+    return nullptr;
+  }
+
+  Block& block = blocks[current];
+  Header* header = (Header*)(block.memory + block.used);
+  header->size = size;
+  block.used += needed;
+  last = (unsigned char*)(header + 1);
+
+  stats.allocations++;
+  in_use += needed;
+  stats.peak_bytes = std::max(stats.peak_bytes, in_use);
+  return last;
+}
+
+void* DecodeArena::reallocate(void* pointer, size_t size) {
+  if (!pointer) {
+    return allocate(size);
+  }
+  stats.reallocations++;
+  Header* header = (Header*)pointer - 1;
+
+  // the most recent allocation can grow in place, which covers stb's growing zlib buffers
+  size_t old_needed = (header->size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  size_t new_needed = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  if (pointer == last && blocks[current].used - old_needed + new_needed <= blocks[current].size) {
+    Block& block = blocks[current];
+    block.used = block.used - old_needed + new_needed;
+    in_use = in_use - old_needed + new_needed;
+    stats.peak_bytes = std::max(stats.peak_bytes, in_use);
+    header->size = size;
+    stats.in_place_reallocations++;
+    return pointer;
+  }
+
+  void* moved = allocate(size);
+  if (!moved) {
+    return nullptr; // the old allocation stays valid, as with realloc
+  }
+  std::memcpy(moved, pointer, std::min(header->size, size));
+  return moved;
+}
+
+void DecodeArena::release(void*) {
+  // memory comes back on reset()
+}
+
+void DecodeArena::reset() {
+  // merge the blocks into one big enough for everything the last round needed
+  if (blocks.size() > 1) {
+    size_t total = 0;
+    for (Block& block : blocks) {
+      total += block.size;
+      std::free(block.memory);
+    }
+    blocks.clear();
+    add_block(total);
+  }
+  for (Block& block : blocks) {
+    block.used = 0;
+  }
+  current = 0;
+  last = nullptr;
+  in_use = 0;
+  stats.resets++;
+  publish();
+}
+
+void DecodeArena::publish() {
+  std::lock_guard<std::mutex> lock(totals_mutex);
+  totals.allocations += stats.allocations - published.allocations;
+  totals.reallocations += stats.reallocations - published.reallocations;
+  totals.in_place_reallocations += stats.in_place_reallocations - published.in_place_reallocations;
+  totals.heap_allocations += stats.heap_allocations - published.heap_allocations;
+  totals.resets += stats.resets - published.resets;
+  totals.peak_bytes = std::max(totals.peak_bytes, stats.peak_bytes);
+  totals.arenas += published.resets == 0;
+  published = stats;
+}
+
+const DecodeArena::Statistics& DecodeArena::statistics() const {
+  return stats;
+}
+
+DecodeArena::Statistics DecodeArena::total_statistics() {
+  std::lock_guard<std::mutex> lock(totals_mutex);
+  return totals;
+}
+
+#endif
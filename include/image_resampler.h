@@ -0,0 +1,245 @@
+#ifndef IMAGE_RESAMPLER_H
+#define IMAGE_RESAMPLER_H
+
+#include <job_pool.h>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_RESAMPLER_X86
+#endif
+
+enum class ResampleFilter {
+  mitchell, // B = C = 1/3, soft with little ringing
+  lanczos3, // sharper, rings on hard edges
+};
+
+// Separable two-pass resampler used to clamp oversized images at load. The horizontal
+// pass runs per source row, the vertical pass per destination row, each split into row
+// bands across the job pool; the inner loops use AVX2/FMA or SSE when the CPU has them.
+class ImageResampler {
+private:
+  struct Contribution {
+    int first;
+    std::vector<float> weights;
+  };
+  int max_dimension;
+  ResampleFilter filter;
+  unsigned int threads; // most bands a pass is split into
+
+  float kernel(float x) const;
+  float radius() const;
+  std::vector<Contribution> contributions(int source_size, int destination_size) const;
+
+  void horizontal(const unsigned char* pixels, int width, int channels, const std::vector<Contribution> &columns,
+                  float* output, int first_row, int last_row) const;
+  void vertical(const float* rows, int width, int channels, const std::vector<Contribution> &rows_used,
+                unsigned char* output, int first_row, int last_row) const;
+
+  template <typename Band>
+  void parallel(int count, Band band) const;
+public:
+  ImageResampler(int max_dimension = 2048, ResampleFilter filter = ResampleFilter::mitchell,
+                 unsigned int threads = job_pool.size() + 1);
+
+  std::vector<unsigned char> resample(const unsigned char* pixels, int width, int height, int channels,
+                                      int new_width, int new_height) const;
+
+  // downscales an image whose largest side exceeds max_dimension, keeping its aspect ratio;
+  // returns false and leaves everything untouched when it already fits
+  bool clamp(const unsigned char* pixels, int &width, int &height, int channels, std::vector<unsigned char> &output) const;
+};
+
+ImageResampler::ImageResampler(int max_dimension, ResampleFilter filter, unsigned int threads)
+  : max_dimension(max_dimension), filter(filter), threads(std::max(threads, 1u)) {}
+
+float ImageResampler::kernel(float x) const {
+  x = std::fabs(x);
+  if (filter == ResampleFilter::lanczos3) {
+    if (x < 1e-6f) {
+      return 1.0f;
+    }
+    if (x >= 3.0f) {
+      return 0.0f;
+    }
+    float pi_x = float(M_PI) * x;
+    return 3.0f * std::sin(pi_x) * std::sin(pi_x / 3.0f) / (pi_x * pi_x);
+  }
+
+  const float B = 1.0f / 3.0f;
+  const float C = 1.0f / 3.0f;
+  if (x < 1.0f) {
+    return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0f;
+  }
+  if (x < 2.0f) {
+    return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0f;
+  }
+  return 0.0f;
+}
+
+float ImageResampler::radius() const {
+  return filter == ResampleFilter::lanczos3 ? 3.0f : 2.0f;
+}
+
+std::vector<ImageResampler::Contribution> ImageResampler::contributions(int source_size, int destination_size) const {
+  // when shrinking, the kernel is stretched to cover every source texel it averages
+  float scale = float(destination_size) / source_size;
+  float stretch = std::max(1.0f / scale, 1.0f);
+  float support = radius() * stretch;
+
+  std::vector<Contribution> contributions(destination_size);
+  for (int i = 0; i < destination_size; i++) {
+    float center = (i + 0.5f) / scale - 0.5f;
+    int first = std::max((int)std::ceil(center - support), 0);
+    int last = std::min((int)std::floor(center + support), source_size - 1);
+
+    Contribution& contribution = contributions[i];
+    contribution.first = first;
+    float total = 0.0f;
+    for (int j = first; j <= last; j++) {
+      float weight = kernel((j - center) / stretch);
+      contribution.weights.push_back(weight);
+      total += weight;
+    }
+    for (float& weight : contribution.weights) {
+      weight /= total;
+    }
+  }
+  return contributions;
+}
+
+#ifdef IMAGE_RESAMPLER_X86
+__attribute__((target("avx2,fma")))
+static void resampler_accumulate_avx2(float* sum, const float* row, float weight, int count, int &done) {
+  __m256 w = _mm256_set1_ps(weight);
+  int i = done;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(&sum[i], _mm256_fmadd_ps(_mm256_loadu_ps(&row[i]), w, _mm256_loadu_ps(&sum[i])));
+  }
+  done = i;
+}
+
+__attribute__((target("sse2")))
+static void resampler_accumulate_sse(float* sum, const float* row, float weight, int count, int &done) {
+  __m128 w = _mm_set1_ps(weight);
+  int i = done;
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(&sum[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&row[i]), w), _mm_loadu_ps(&sum[i])));
+  }
+  done = i;
+}
+#endif
+
+// sum[i] += row[i] * weight
+static void resampler_accumulate(float* sum, const float* row, float weight, int count) {
+  int done = 0;
+#ifdef IMAGE_RESAMPLER_X86
+  static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (avx2) {
+    resampler_accumulate_avx2(sum, row, weight, count, done);
+  }
+  resampler_accumulate_sse(sum, row, weight, count, done);
+#endif
+  for (; done < count; done++) {
+    sum[done] += row[done] * weight;
+  }
+}
+
+void ImageResampler::horizontal(const unsigned char* pixels, int width, int channels, const std::vector<Contribution> &columns,
+                                float* output, int first_row, int last_row) const {
+  std::vector<float> row((size_t)width * channels);
+  int output_stride = columns.size() * channels;
+  for (int y = first_row; y < last_row; y++) {
+    const unsigned char* source = &pixels[(size_t)y * width * channels];
+    for (size_t i = 0; i < row.size(); i++) {
+      row[i] = source[i];
+    }
+    float* destination = &output[(size_t)y * output_stride];
+    for (size_t x = 0; x < columns.size(); x++) {
+      const Contribution& column = columns[x];
+      float* pixel = &destination[x * channels];
+#ifdef IMAGE_RESAMPLER_X86
+      if (channels == 4) {
+        // one RGBA texel per SSE register
+        __m128 sum = _mm_setzero_ps();
+        for (size_t tap = 0; tap < column.weights.size(); tap++) {
+          __m128 texel = _mm_loadu_ps(&row[(size_t)(column.first + tap) * 4]);
+          sum = _mm_add_ps(sum, _mm_mul_ps(texel, _mm_set1_ps(column.weights[tap])));
+        }
+        _mm_storeu_ps(pixel, sum);
+        continue;
+      }
+#endif
+      std::fill(pixel, pixel + channels, 0.0f);
+      // taps are adjacent texels, so each one is a short run of `channels` floats
+      for (size_t tap = 0; tap < column.weights.size(); tap++) {
+        const float* texel = &row[(size_t)(column.first + tap) * channels];
+        for (int channel = 0; channel < channels; channel++) {
+          pixel[channel] += texel[channel] * column.weights[tap];
+        }
+      }
+    }
+  }
+}
+
+void ImageResampler::vertical(const float* rows, int width, int channels, const std::vector<Contribution> &rows_used,
+                              unsigned char* output, int first_row, int last_row) const {
+  int stride = width * channels;
+  std::vector<float> sum(stride);
+  for (int y = first_row; y < last_row; y++) {
+    const Contribution& contribution = rows_used[y];
+    std::fill(sum.begin(), sum.end(), 0.0f);
+    // whole rows are weighted and summed, the part that vectorizes best
+    for (size_t tap = 0; tap < contribution.weights.size(); tap++) {
+      resampler_accumulate(sum.data(), &rows[(size_t)(contribution.first + tap) * stride], contribution.weights[tap], stride);
+    }
+    unsigned char* destination = &output[(size_t)y * stride];
+    for (int i = 0; i < stride; i++) {
+      destination[i] = (unsigned char)std::clamp(sum[i] + 0.5f, 0.0f, 255.0f);
+    }
+  }
+}
+
+template <typename Band>
+void ImageResampler::parallel(int count, Band band) const {
+  // decodes already run on pool workers, parallel_for is safe to call from them
+  int bands = std::min<int>(threads, std::max(count / 16, 1));
+  job_pool.parallel_for(bands, [&](size_t i) {
+    band(count * i / bands, count * (i + 1) / bands);
+  });
+}
+
+std::vector<unsigned char> ImageResampler::resample(const unsigned char* pixels, int width, int height, int channels,
+                                                    int new_width, int new_height) const {
+  std::vector<Contribution> columns = contributions(width, new_width);
+  std::vector<Contribution> rows = contributions(height, new_height);
+
+  std::vector<float> intermediate((size_t)new_width * height * channels);
+  parallel(height, [&](int first, int last) {
+    horizontal(pixels, width, channels, columns, intermediate.data(), first, last);
+  });
+
+  std::vector<unsigned char> output((size_t)new_width * new_height * channels);
+  parallel(new_height, [&](int first, int last) {
+    vertical(intermediate.data(), new_width, channels, rows, output.data(), first, last);
+  });
+  return output;
+}
+
+bool ImageResampler::clamp(const unsigned char* pixels, int &width, int &height, int channels, std::vector<unsigned char> &output) const {
+  int largest = std::max(width, height);
+  if (max_dimension <= 0 || largest <= max_dimension) {
+    return false;
+  }
+  int new_width = std::max((int)std::lround((double)width * max_dimension / largest), 1);
+  int new_height = std::max((int)std::lround((double)height * max_dimension / largest), 1);
+  output = resample(pixels, width, height, channels, new_width, new_height);
+  width = new_width;
+  height = new_height;
+  return true;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <future>
+#include <type_traits>
+#include <algorithm>
+
+// Fixed set of worker threads shared by everything that splits work into jobs, so
+// loaders do not each spawn and join their own threads.
+class JobPool {
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable job_available;
+  std::deque<std::function<void()>> jobs;
+  bool stopping {false};
+
+  void run();
+public:
+  JobPool(unsigned int threads = std::max(std::thread::hardware_concurrency(), 2u) - 1);
+  JobPool(const JobPool&) = delete;
+  JobPool& operator=(const JobPool&) = delete;
+  ~JobPool();
+
+  void submit(std::function<void()> job);
+
+  // runs `work` on a worker; the future holds its result
+  template <typename Work>
+  std::future<std::invoke_result_t<Work>> async(Work work);
+
+  // calls `body(i)` for every i in [0, count) on the workers and the calling thread and
+  // returns once all calls have finished; safe to nest, the caller never just waits
+  template <typename Body>
+  void parallel_for(size_t count, Body body);
+
+  unsigned int size() const;
+};
+
+inline JobPool job_pool;
+
+JobPool::JobPool(unsigned int threads) {
+  for (unsigned int i = 0; i < threads; i++) {
+    workers.emplace_back(&JobPool::run, this);
+  }
+}
+
+JobPool::~JobPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  job_available.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void JobPool::run() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      job_available.wait(lock, [&]() { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void JobPool::submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  job_available.notify_one();
+}
+
+template <typename Work>
+std::future<std::invoke_result_t<Work>> JobPool::async(Work work) {
+  // std::function needs a copyable job, the task is shared instead of moved in
+  auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Work>()>>(std::move(work));
+  std::future<std::invoke_result_t<Work>> result = task->get_future();
+  submit([task]() { (*task)(); });
+  return result;
+}
+
+template <typename Body>
+void JobPool::parallel_for(size_t count, Body body) {
+  struct Progress {
+    std::atomic<size_t> next {0};
+    std::atomic<size_t> done {0};
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  // helpers that only start after every index is claimed leave without touching `body`
+  auto progress = std::make_shared<Progress>();
+  auto work = [progress, count, &body]() {
+    for (size_t i; (i = progress->next++) < count;) {
+      body(i);
+      if (++progress->done == count) {
+        std::lock_guard<std::mutex> lock(progress->mutex);
+        progress->finished.notify_all();
+      }
+    }
+  };
+  size_t helpers = std::min<size_t>(workers.size(), count > 0 ? count - 1 : 0);
+  for (size_t i = 0; i < helpers; i++) {
+    submit(work);
+  }
+  work();
+  std::unique_lock<std::mutex> lock(progress->mutex);
+  progress->finished.wait(lock, [&]() { return progress->done == count; });
+}
+
+unsigned int JobPool::size() const {
+  return workers.size();
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+// LZ4 block format (no frame): a run of sequences, each a token, literals and a 16-bit
+// back reference. The compressor is the plain greedy single-probe one, the decompressor
+// checks every length and offset against both buffers, so a corrupt pack cannot make it
+// read or write out of bounds.
+namespace lz4_block {
+  const size_t MIN_MATCH = 4;
+  const size_t LAST_LITERALS = 5;  // the block always ends with at least this many literals
+  const size_t MATCH_LIMIT = 12;   // no match starts this close to the end
+  const size_t MAX_OFFSET = 65535;
+  const int HASH_BITS = 16;
+
+  inline uint32_t read_32(const unsigned char* bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    return value;
+  }
+
+  inline void write_length(std::vector<unsigned char> &output, size_t length) {
+    for (; length >= 255; length -= 255) {
+      output.push_back(255);
+    }
+    output.push_back((unsigned char)length);
+  }
+
+  inline void write_sequence(std::vector<unsigned char> &output, const unsigned char* literals, size_t literal_length,
+                             size_t offset, size_t match_length) {
+    size_t extra_match = match_length - MIN_MATCH;
+    output.push_back((unsigned char)((std::min<size_t>(literal_length, 15) << 4) | (match_length ? std::min<size_t>(extra_match, 15) : 0)));
+    if (literal_length >= 15) {
+      write_length(output, literal_length - 15);
+    }
+    output.insert(output.end(), literals, literals + literal_length);
+    if (match_length == 0) {
+      return; // last sequence: literals only
+    }
+    output.push_back(offset & 0xFF);
+    output.push_back(offset >> 8);
+    if (extra_match >= 15) {
+      write_length(output, extra_match - 15);
+    }
+  }
+
+  inline std::vector<unsigned char> compress(const unsigned char* input, size_t size) {
+    std::vector<unsigned char> output;
+    output.reserve(size + size / 255 + 16);
+    std::vector<int64_t> table(size_t(1) << HASH_BITS, -1);
+    size_t anchor = 0;
+    for (size_t i = 0; size > MATCH_LIMIT && i < size - MATCH_LIMIT;) {
+      uint32_t sequence = read_32(&input[i]);
+      uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+      int64_t candidate = table[hash];
+      table[hash] = i;
+      if (candidate < 0 || i - candidate > MAX_OFFSET || read_32(&input[candidate]) != sequence) {
+        i++;
+        continue;
+      }
+      size_t length = MIN_MATCH;
+      while (i + length < size - LAST_LITERALS && input[candidate + length] == input[i + length]) {
+        length++;
+      }
+      write_sequence(output, &input[anchor], i - anchor, i - candidate, length);
+      i += length;
+      anchor = i;
+    }
+    write_sequence(output, &input[anchor], size - anchor, 0, 0);
+    return output;
+  }
+
+  // `output` must be sized to the exact decompressed size; false on malformed input
+  inline bool decompress(const unsigned char* input, size_t size, unsigned char* output, size_t output_size) {
+    const unsigned char* end = input + size;
+    size_t written = 0;
+    auto read_length = [&](size_t &length) {
+      unsigned char byte = 255;
+      while (byte == 255) {
+        if (input == end) {
+          return false;
+        }
+        byte = *input++;
+        length += byte;
+      }
+      return true;
+    };
+
+    while (input < end) {
+      unsigned char token = *input++;
+      size_t literal_length = token >> 4;
+      if (literal_length == 15 && !read_length(literal_length)) {
+        return false;
+      }
+      if (literal_length > (size_t)(end - input) || literal_length > output_size - written) {
+        return false;
+      }
+      std::copy_n(input, literal_length, &output[written]);
+      input += literal_length;
+      written += literal_length;
+      if (input == end) {
+        break;
+      }
+
+      if (end - input < 2) {
+        return false;
+      }
+      size_t offset = input[0] | (input[1] << 8);
+      input += 2;
+      size_t match_length = token & 15;
+      if (match_length == 15 && !read_length(match_length)) {
+        return false;
+      }
+      match_length += MIN_MATCH;
+      if (offset == 0 || offset > written || match_length > output_size - written) {
+        return false;
+      }
+      if (offset >= match_length) {
+        std::memcpy(&output[written], &output[written - offset], match_length);
+        written += match_length;
+        continue;
+      }
+      // an overlapping match repeats its last `offset` bytes, copied byte by byte
+      for (size_t i = 0; i < match_length; i++, written++) {
+        output[written] = output[written - offset];
+      }
+    }
+    return written == output_size;
+  }
+}
+
+#endif
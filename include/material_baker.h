@@ -0,0 +1,144 @@
+#ifndef MATERIAL_BAKER_H
+#define MATERIAL_BAKER_H
+
+#include <glad/glad.h>
+#include <image_resampler.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <regex>
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// `mix(texture(first, uv), texture(second, uv), factor)` with a constant factor
+struct StaticBlend {
+  std::string first;
+  std::string second;
+  float factor;
+};
+
+struct BakeSource {
+  const unsigned char* pixels; // RGBA, bottom row first as uploaded
+  int width;
+  int height;
+  GLenum wrap_s;
+  GLenum wrap_t;
+};
+
+struct BakedTexture {
+  int width;
+  int height;
+  std::vector<unsigned char> pixels; // RGBA
+  float uv_transform[4];              // scale.xy, offset.zw mapping mesh UVs into the baked texture
+};
+
+// Pre-composites constant blends of two textures sampled at the same coordinates, so
+// the fragment shader samples once instead of twice. The result covers the UV range
+// the mesh actually uses with each source's wrap mode applied, which keeps it exact
+// for sources sampled with different wrap modes or outside [0, 1].
+class MaterialBaker {
+private:
+  int wrap(int texel, int size, GLenum mode) const;
+  void mix_row(const unsigned char* first, const unsigned char* second, unsigned char* output, int count, int weight) const;
+public:
+  // finds a constant two-texture blend in a fragment shader source
+  static std::optional<StaticBlend> detect(std::string_view fragment_source);
+
+  // `uv_min`/`uv_max` bound the texture coordinates of the meshes using the material
+  BakedTexture bake(const BakeSource &first, const BakeSource &second, float factor, const float uv_min[2], const float uv_max[2]) const;
+};
+
+std::optional<StaticBlend> MaterialBaker::detect(std::string_view fragment_source) {
+  static const std::regex pattern(
+    R"(mix\s*\(\s*texture\s*\(\s*(\w+)\s*,\s*(\w+)\s*\)\s*,\s*texture\s*\(\s*(\w+)\s*,\s*(\w+)\s*\)\s*,\s*([0-9]*\.?[0-9]+)f?\s*\))");
+  std::match_results<std::string_view::const_iterator> match;
+  if (!std::regex_search(fragment_source.begin(), fragment_source.end(), match, pattern) || match[2] != match[4]) {
+    return std::nullopt;
+  }
+  return StaticBlend {match[1], match[3], std::stof(match[5])};
+}
+
+int MaterialBaker::wrap(int texel, int size, GLenum mode) const {
+  switch (mode) {
+  case GL_REPEAT:
+    return ((texel % size) + size) % size;
+  case GL_MIRRORED_REPEAT: {
+    int period = ((texel % (2 * size)) + 2 * size) % (2 * size);
+    return period < size ? period : 2 * size - 1 - period;
+  }
+  default:
+    return std::clamp(texel, 0, size - 1);
+  }
+}
+
+void MaterialBaker::mix_row(const unsigned char* first, const unsigned char* second, unsigned char* output, int count, int weight) const {
+  // first * (256 - weight) + second * weight, rounded, with weight in 1/256ths
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i first_weight = _mm_set1_epi16(256 - weight);
+  const __m128i second_weight = _mm_set1_epi16(weight);
+  const __m128i half = _mm_set1_epi16(128);
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)&first[i]);
+    __m128i b = _mm_loadu_si128((const __m128i*)&second[i]);
+    __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), first_weight),
+                                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), second_weight));
+    __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), first_weight),
+                                 _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), second_weight));
+    low = _mm_srli_epi16(_mm_add_epi16(low, half), 8);
+    high = _mm_srli_epi16(_mm_add_epi16(high, half), 8);
+    _mm_storeu_si128((__m128i*)&output[i], _mm_packus_epi16(low, high));
+  }
+#endif
+  for (; i < count; i++) {
+    output[i] = (first[i] * (256 - weight) + second[i] * weight + 128) >> 8;
+  }
+}
+
+BakedTexture MaterialBaker::bake(const BakeSource &first, const BakeSource &second, float factor, const float uv_min[2], const float uv_max[2]) const {
+  // the second source is brought to the resolution of the first so texel grids line up
+  std::vector<unsigned char> resized;
+  BakeSource matched = second;
+  if (second.width != first.width || second.height != first.height) {
+    resized = ImageResampler().resample(second.pixels, second.width, second.height, 4, first.width, first.height);
+    matched = {resized.data(), first.width, first.height, second.wrap_s, second.wrap_t};
+  }
+
+  float range[2] {std::max(uv_max[0] - uv_min[0], 1e-6f), std::max(uv_max[1] - uv_min[1], 1e-6f)};
+  BakedTexture baked;
+  baked.width = std::max((int)std::ceil(range[0] * first.width), 1);
+  baked.height = std::max((int)std::ceil(range[1] * first.height), 1);
+  baked.pixels.resize((size_t)baked.width * baked.height * 4);
+  baked.uv_transform[0] = 1.0f / range[0];
+  baked.uv_transform[1] = 1.0f / range[1];
+  baked.uv_transform[2] = -uv_min[0] / range[0];
+  baked.uv_transform[3] = -uv_min[1] / range[1];
+
+  int weight = (int)std::lround(std::clamp(factor, 0.0f, 1.0f) * 256.0f);
+  int origin_x = (int)std::floor(uv_min[0] * first.width);
+  int origin_y = (int)std::floor(uv_min[1] * first.height);
+  std::vector<unsigned char> first_row(baked.width * 4);
+  std::vector<unsigned char> second_row(baked.width * 4);
+  for (int y = 0; y < baked.height; y++) {
+    // gather both sources with their wrap modes, then blend the whole row at once
+    int first_y = wrap(origin_y + y, first.height, first.wrap_t);
+    int second_y = wrap(origin_y + y, matched.height, matched.wrap_t);
+    for (int x = 0; x < baked.width; x++) {
+      int first_x = wrap(origin_x + x, first.width, first.wrap_s);
+      int second_x = wrap(origin_x + x, matched.width, matched.wrap_s);
+      std::copy_n(&first.pixels[((size_t)first_y * first.width + first_x) * 4], 4, &first_row[x * 4]);
+      std::copy_n(&matched.pixels[((size_t)second_y * matched.width + second_x) * 4], 4, &second_row[x * 4]);
+    }
+    mix_row(first_row.data(), second_row.data(), &baked.pixels[(size_t)y * baked.width * 4], baked.width * 4, weight);
+  }
+  return baked;
+}
+
+#endif
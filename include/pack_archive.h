@@ -0,0 +1,404 @@
+#ifndef PACK_ARCHIVE_H
+#define PACK_ARCHIVE_H
+
+#include <content_hash.h>
+#include <lz4_block.h>
+#include <job_pool.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <span>
+#include <optional>
+#include <atomic>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+// Layout of a pack, little endian:
+//   PackHeader
+//   entry data, each entry starting on a PACK_ALIGNMENT boundary
+//   PackEntry table, sorted by name hash
+//   names, not terminated
+// An LZ4 entry starts with its block count and the stored size of every block, the top
+// bit marking a block kept uncompressed, followed by the blocks themselves.
+const char PACK_MAGIC[8] {'R', 'O', 'T', 'E', 'P', 'A', 'C', 'K'};
+const uint32_t PACK_VERSION = 2;
+const uint64_t PACK_ALIGNMENT = 4096;
+const uint64_t PACK_BLOCK_SIZE = 256 * 1024;
+const uint32_t PACK_RAW_BLOCK = 0x80000000u;
+
+enum class PackCompression : uint16_t {
+  none,
+  lz4, // independent LZ4 blocks of PACK_BLOCK_SIZE bytes, decompressed in parallel
+};
+
+struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_count;
+  uint64_t entries_offset;
+  uint64_t names_offset;
+};
+
+struct PackEntry {
+  uint64_t name_hash;
+  uint64_t offset;
+  uint64_t stored_size; // bytes in the pack
+  uint64_t size;        // bytes once decompressed
+  uint64_t checksum;    // content_hash() of the decompressed bytes
+  uint32_t name_offset; // from names_offset
+  uint16_t name_length;
+  PackCompression compression;
+};
+
+// Builds a pack; used by the `packer` tool.
+class PackWriter {
+private:
+  struct Pending {
+    std::string name;
+    std::vector<unsigned char> bytes;
+    PackEntry entry;
+  };
+  std::vector<Pending> pending;
+
+  std::vector<unsigned char> compress_blocks(const std::vector<unsigned char> &bytes) const;
+public:
+  // LZ4 is kept only when it saves at least an eighth of the entry
+  void add(const std::string &name, std::vector<unsigned char> bytes, bool compress);
+  bool write(const std::string &path) const;
+};
+
+// A pack opened with a single mmap. Looking an asset up is a binary search over the name
+// hashes in the mapped table, and reading an uncompressed entry only faults its pages
+// in. Compressed entries are decompressed block by block across the job pool, straight
+// into the caller's buffer with read(), or once into a kept copy with get(). Each
+// entry's checksum is verified on first access.
+class PackArchive {
+private:
+  const unsigned char* mapping {nullptr};
+  size_t mapping_size {0};
+  const PackHeader* header {nullptr};
+  const PackEntry* entries {nullptr};
+  const char* names {nullptr};
+  std::vector<bool> verified;
+  std::map<size_t, std::vector<unsigned char>> decompressed;
+
+  bool valid() const;
+  const PackEntry* find(std::string_view name) const;
+  bool decompress(const PackEntry &entry, unsigned char* destination) const;
+  bool verify(const PackEntry &entry, const unsigned char* bytes);
+public:
+  PackArchive() = default;
+  PackArchive(const PackArchive&) = delete;
+  PackArchive& operator=(const PackArchive&) = delete;
+  ~PackArchive();
+
+  bool open(const std::string &path);
+  void close();
+  bool is_open() const;
+
+  // the entry's bytes, empty when it is missing or corrupt
+  std::span<const unsigned char> get(std::string_view name);
+
+  // fills `destination`, which holds entry_size() bytes, e.g. a staging buffer about to
+  // be queued for upload; false when the entry is missing or corrupt
+  bool read(std::string_view name, unsigned char* destination);
+  std::optional<size_t> entry_size(std::string_view name) const;
+
+  bool contains(std::string_view name) const;
+  std::vector<std::string_view> entry_names() const;
+  size_t size() const;
+};
+
+void PackWriter::add(const std::string &name, std::vector<unsigned char> bytes, bool compress) {
+  PackEntry entry {};
+  entry.name_hash = content_hash(name.data(), name.size());
+  entry.size = bytes.size();
+  entry.checksum = content_hash(bytes.data(), bytes.size());
+  entry.compression = PackCompression::none;
+  if (compress && !bytes.empty()) {
+    std::vector<unsigned char> compressed = compress_blocks(bytes);
+    if (compressed.size() < bytes.size() - bytes.size() / 8) {
+      bytes = std::move(compressed);
+      entry.compression = PackCompression::lz4;
+    }
+  }
+  entry.stored_size = bytes.size();
+  pending.push_back({name, std::move(bytes), entry});
+}
+
+std::vector<unsigned char> PackWriter::compress_blocks(const std::vector<unsigned char> &bytes) const {
+  uint32_t count = (bytes.size() + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE;
+  std::vector<std::vector<unsigned char>> blocks(count);
+  std::vector<uint32_t> sizes(count);
+  job_pool.parallel_for(count, [&](size_t i) {
+    const unsigned char* block = &bytes[i * PACK_BLOCK_SIZE];
+    size_t size = std::min(PACK_BLOCK_SIZE, bytes.size() - i * PACK_BLOCK_SIZE);
+    blocks[i] = lz4_block::compress(block, size);
+    sizes[i] = blocks[i].size();
+    if (blocks[i].size() >= size) {
+      blocks[i].assign(block, block + size);
+      sizes[i] = size | PACK_RAW_BLOCK;
+    }
+  });
+
+  std::vector<unsigned char> output(sizeof(uint32_t) * (count + 1));
+  std::memcpy(&output[0], &count, sizeof(count));
+  std::memcpy(&output[sizeof(count)], sizes.data(), sizes.size() * sizeof(uint32_t));
+  for (const std::vector<unsigned char>& block : blocks) {
+    output.insert(output.end(), block.begin(), block.end());
+  }
+  return output;
+}
+
+bool PackWriter::write(const std::string &path) const {
+  std::vector<const Pending*> sorted;
+  for (const Pending& file : pending) {
+    sorted.push_back(&file);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Pending* a, const Pending* b) {
+    return a->entry.name_hash < b->entry.name_hash || (a->entry.name_hash == b->entry.name_hash && a->name < b->name);
+  });
+
+  std::vector<unsigned char> pack(sizeof(PackHeader));
+  std::vector<PackEntry> table;
+  std::string names;
+  for (const Pending* file : sorted) {
+    pack.resize((pack.size() + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT);
+    PackEntry entry = file->entry;
+    entry.offset = pack.size();
+    entry.name_offset = names.size();
+    entry.name_length = file->name.size();
+    pack.insert(pack.end(), file->bytes.begin(), file->bytes.end());
+    names += file->name;
+    table.push_back(entry);
+  }
+
+  pack.resize((pack.size() + alignof(PackEntry) - 1) / alignof(PackEntry) * alignof(PackEntry));
+  PackHeader header {};
+  std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  header.version = PACK_VERSION;
+  header.entry_count = table.size();
+  header.entries_offset = pack.size();
+  header.names_offset = header.entries_offset + table.size() * sizeof(PackEntry);
+  std::memcpy(pack.data(), &header, sizeof(header));
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write((const char*)pack.data(), pack.size());
+  file.write((const char*)table.data(), table.size() * sizeof(PackEntry));
+  file.write(names.data(), names.size());
+  return (bool)file;
+}
+
+PackArchive::~PackArchive() {
+  close();
+}
+
+bool PackArchive::open(const std::string &path) {
+  close();
+  int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (descriptor == -1 || fstat(descriptor, &status) == -1 || status.st_size < (off_t)sizeof(PackHeader)) {
+    std::cout << "ERROR::PACK_ARCHIVE::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+    if (descriptor != -1) {
+      ::close(descriptor);
+    }
+    return false;
+  }
+  void* mapped = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  ::close(descriptor);
+  if (mapped == MAP_FAILED) {
+    std::cout << "ERROR::PACK_ARCHIVE::MMAP_FAILED " << path << std::endl;
+    return false;
+  }
+
+  mapping = (const unsigned char*)mapped;
+  mapping_size = status.st_size;
+  header = (const PackHeader*)mapping;
+  entries = (const PackEntry*)(mapping + header->entries_offset);
+  names = (const char*)(mapping + header->names_offset);
+  if (!valid()) {
+    std::cout << "ERROR::PACK_ARCHIVE::INVALID " << path << std::endl;
+    close();
+    return false;
+  }
+  // entries are read one at a time in no particular order, readahead past one is wasted
+  madvise((void*)mapping, mapping_size, MADV_RANDOM);
+  verified.assign(header->entry_count, false);
+  return true;
+}
+
+bool PackArchive::valid() const {
+  if (std::memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header->version != PACK_VERSION ||
+      header->entries_offset % alignof(PackEntry) != 0 || header->entries_offset > mapping_size ||
+      (mapping_size - header->entries_offset) / sizeof(PackEntry) < header->entry_count ||
+      header->names_offset != header->entries_offset + header->entry_count * sizeof(PackEntry)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header->entry_count; i++) {
+    const PackEntry& entry = entries[i];
+    if (entry.offset > mapping_size || entry.stored_size > mapping_size - entry.offset ||
+        header->names_offset + entry.name_offset + entry.name_length > mapping_size ||
+        (entry.compression == PackCompression::none && entry.stored_size != entry.size) ||
+        entry.compression > PackCompression::lz4 || (i > 0 && entries[i - 1].name_hash > entry.name_hash)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PackArchive::close() {
+  if (mapping) {
+    munmap((void*)mapping, mapping_size);
+  }
+  mapping = nullptr;
+  mapping_size = 0;
+  header = nullptr;
+  entries = nullptr;
+  names = nullptr;
+  verified.clear();
+  decompressed.clear();
+}
+
+bool PackArchive::is_open() const {
+  return mapping != nullptr;
+}
+
+const PackEntry* PackArchive::find(std::string_view name) const {
+  if (!mapping) {
+    return nullptr;
+  }
+  uint64_t hash = content_hash(name.data(), name.size());
+  const PackEntry* end = entries + header->entry_count;
+  const PackEntry* entry = std::lower_bound(entries, end, hash, [](const PackEntry& entry, uint64_t hash) { return entry.name_hash < hash; });
+  for (; entry != end && entry->name_hash == hash; entry++) {
+    if (std::string_view(names + entry->name_offset, entry->name_length) == name) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+bool PackArchive::decompress(const PackEntry &entry, unsigned char* destination) const {
+  const unsigned char* stored = mapping + entry.offset;
+  if (entry.compression == PackCompression::none) {
+    std::copy_n(stored, entry.size, destination);
+    return true;
+  }
+
+  uint32_t count;
+  if (entry.stored_size < sizeof(count)) {
+    return false;
+  }
+  std::memcpy(&count, stored, sizeof(count));
+  if (count != (entry.size + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE || (entry.stored_size - sizeof(count)) / sizeof(uint32_t) < count) {
+    return false;
+  }
+  std::vector<uint32_t> sizes(count);
+  std::memcpy(sizes.data(), stored + sizeof(count), count * sizeof(uint32_t));
+  std::vector<uint64_t> offsets(count);
+  uint64_t offset = sizeof(count) + count * sizeof(uint32_t);
+  for (uint32_t i = 0; i < count; i++) {
+    offsets[i] = offset;
+    offset += sizes[i] & ~PACK_RAW_BLOCK;
+  }
+  if (offset != entry.stored_size) {
+    return false;
+  }
+
+  std::atomic<bool> intact {true};
+  job_pool.parallel_for(count, [&](size_t i) {
+    size_t size = std::min(PACK_BLOCK_SIZE, entry.size - i * PACK_BLOCK_SIZE);
+    const unsigned char* block = stored + offsets[i];
+    unsigned char* output = destination + i * PACK_BLOCK_SIZE;
+    if (sizes[i] & PACK_RAW_BLOCK) {
+      if ((sizes[i] & ~PACK_RAW_BLOCK) != size) {
+        intact = false;
+        return;
+      }
+      std::copy_n(block, size, output);
+    }
+    else if (!lz4_block::decompress(block, sizes[i], output, size)) {
+      intact = false;
+    }
+  });
+  return intact;
+}
+
+bool PackArchive::verify(const PackEntry &entry, const unsigned char* bytes) {
+  size_t index = &entry - entries;
+  if (!verified[index]) {
+    if (content_hash(bytes, entry.size) != entry.checksum) {
+      std::cout << "ERROR::PACK_ARCHIVE::CHECKSUM_MISMATCH " << std::string_view(names + entry.name_offset, entry.name_length) << std::endl;
+      return false;
+    }
+    verified[index] = true;
+  }
+  return true;
+}
+
+std::span<const unsigned char> PackArchive::get(std::string_view name) {
+  const PackEntry* entry = find(name);
+  if (!entry) {
+    return {};
+  }
+  if (entry->compression == PackCompression::none) {
+    const unsigned char* bytes = mapping + entry->offset;
+    return verify(*entry, bytes) ? std::span<const unsigned char>(bytes, entry->size) : std::span<const unsigned char>();
+  }
+
+  size_t index = entry - entries;
+  auto found = decompressed.find(index);
+  if (found == decompressed.end()) {
+    std::vector<unsigned char> output(entry->size);
+    if (!read(name, output.data())) {
+      return {};
+    }
+    found = decompressed.emplace(index, std::move(output)).first;
+  }
+  return found->second;
+}
+
+bool PackArchive::read(std::string_view name, unsigned char* destination) {
+  const PackEntry* entry = find(name);
+  if (!entry) {
+    return false;
+  }
+  if (!decompress(*entry, destination)) {
+    std::cout << "ERROR::PACK_ARCHIVE::CORRUPT_ENTRY " << name << std::endl;
+    return false;
+  }
+  return verify(*entry, destination);
+}
+
+std::optional<size_t> PackArchive::entry_size(std::string_view name) const {
+  const PackEntry* entry = find(name);
+  return entry ? std::optional<size_t>(entry->size) : std::nullopt;
+}
+
+bool PackArchive::contains(std::string_view name) const {
+  return find(name) != nullptr;
+}
+
+std::vector<std::string_view> PackArchive::entry_names() const {
+  std::vector<std::string_view> result;
+  for (uint32_t i = 0; i < size(); i++) {
+    result.emplace_back(names + entries[i].name_offset, entries[i].name_length);
+  }
+  return result;
+}
+
+size_t PackArchive::size() const {
+  return header ? header->entry_count : 0;
+}
+
+#endif
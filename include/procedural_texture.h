@@ -0,0 +1,139 @@
+#ifndef PROCEDURAL_TEXTURE_H
+#define PROCEDURAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <shader.h>
+#include <state_cache.h>
+
+#include <map>
+#include <optional>
+#include <algorithm>
+
+enum class ProceduralPattern {
+  checker,  // `scale` x `scale` cells alternating between the two colors
+  gradient, // first color at the bottom, second at the top
+  noise,    // tiling fractal value noise over a `scale` x `scale` lattice
+};
+
+struct ProceduralDescription {
+  ProceduralPattern pattern;
+  int width {256};
+  int height {256};
+  float color_a[4] {0.0f, 0.0f, 0.0f, 1.0f};
+  float color_b[4] {1.0f, 1.0f, 1.0f, 1.0f};
+  float scale {8.0f};
+  int octaves {4};
+  float seed {0.0f};
+
+  auto operator<=>(const ProceduralDescription&) const = default;
+};
+
+// Generates checkers, gradients and noise on the GPU instead of shipping and decoding
+// images: each one is drawn by src/procedural.fs into a texture attached to a
+// framebuffer, then mipmapped. Textures are cached by description, so asking for the
+// same one again costs a map lookup.
+class ProceduralTextures {
+private:
+  std::optional<Shader> program;
+  unsigned int framebuffer {0};
+  unsigned int vertex_array {0};
+  std::map<ProceduralDescription, unsigned int> textures;
+
+  unsigned int render(const ProceduralDescription &description);
+public:
+  ProceduralTextures() = default;
+  ProceduralTextures(const ProceduralTextures&) = delete;
+  ProceduralTextures& operator=(const ProceduralTextures&) = delete;
+
+  // RGBA8 texture with a full mip chain, rendered on first use
+  unsigned int get(const ProceduralDescription &description);
+
+  // deletes every generated texture, call while the context is current
+  void clear();
+  size_t size() const;
+};
+
+unsigned int ProceduralTextures::get(const ProceduralDescription &description) {
+  auto found = textures.find(description);
+  if (found != textures.end()) {
+    return found->second;
+  }
+  unsigned int texture = render(description);
+  textures.emplace(description, texture);
+  return texture;
+}
+
+unsigned int ProceduralTextures::render(const ProceduralDescription &description) {
+  if (!program) {
+    program.emplace("src/procedural.vs", "src/procedural.fs");
+  }
+  if (!framebuffer) {
+    glGenFramebuffers(1, &framebuffer);
+    // core profile draws need a vertex array, even an empty one
+    glGenVertexArrays(1, &vertex_array);
+  }
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  state_cache.bind_texture(0, GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, description.width, description.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+  int previous_framebuffer;
+  int previous_vertex_array;
+  int previous_viewport[4];
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+  glGetIntegerv(GL_VIEWPORT, previous_viewport);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::PROCEDURAL_TEXTURE::FRAMEBUFFER_INCOMPLETE" << std::endl;
+  }
+  glViewport(0, 0, description.width, description.height);
+
+  float color_a[4];
+  float color_b[4];
+  std::copy_n(description.color_a, 4, color_a);
+  std::copy_n(description.color_b, 4, color_b);
+  program->use();
+  program->set_int("pattern", (int)description.pattern);
+  program->set_float_sin("color_a", color_a);
+  program->set_float_sin("color_b", color_b);
+  program->set_float("scale", description.scale);
+  program->set_int("octaves", description.octaves);
+  program->set_float("seed", description.seed);
+  glBindVertexArray(vertex_array);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  // detach so the texture is not both a render target and sampled later on
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+  glBindVertexArray(previous_vertex_array);
+  glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+
+  state_cache.bind_texture(0, GL_TEXTURE_2D, texture);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  return texture;
+}
+
+void ProceduralTextures::clear() {
+  for (auto& [description, texture] : textures) {
+    state_cache.forget_texture(texture);
+    glDeleteTextures(1, &texture);
+  }
+  textures.clear();
+  if (framebuffer) {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteVertexArrays(1, &vertex_array);
+    framebuffer = 0;
+    vertex_array = 0;
+  }
+}
+
+size_t ProceduralTextures::size() const {
+  return textures.size();
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SAMPLER_REGISTRY_H
+#define SAMPLER_REGISTRY_H
+
+#include <glad/glad.h>
+#include <state_cache.h>
+
+#include <map>
+
+struct SamplerDescription {
+  GLenum wrap_s {GL_REPEAT};
+  GLenum wrap_t {GL_REPEAT};
+  GLenum min_filter {GL_LINEAR};
+  GLenum mag_filter {GL_LINEAR};
+
+  auto operator<=>(const SamplerDescription&) const = default;
+};
+
+// Sampling state lives in shared sampler objects instead of in every texture, so any
+// number of textures reuse a handful of samplers and filtering changes touch only those.
+class SamplerRegistry {
+private:
+  std::map<SamplerDescription, unsigned int> samplers;
+  GLenum min_filter_override {0};
+  GLenum mag_filter_override {0};
+public:
+  // returns the sampler object for `description`, creating it on first use
+  unsigned int get(const SamplerDescription &description);
+  void bind(unsigned int unit, const SamplerDescription &description);
+
+  // overrides filtering on every registered sampler, e.g. for a quality setting
+  void set_filter(GLenum min_filter, GLenum mag_filter);
+
+  size_t size() const;
+  void clear();
+};
+
+unsigned int SamplerRegistry::get(const SamplerDescription &description) {
+  auto found = samplers.find(description);
+  if (found != samplers.end()) {
+    return found->second;
+  }
+
+  unsigned int sampler;
+  glGenSamplers(1, &sampler);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, description.wrap_s);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, description.wrap_t);
+  glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, min_filter_override ? min_filter_override : description.min_filter);
+  glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, mag_filter_override ? mag_filter_override : description.mag_filter);
+  samplers[description] = sampler;
+  return sampler;
+}
+
+void SamplerRegistry::bind(unsigned int unit, const SamplerDescription &description) {
+  state_cache.bind_sampler(unit, get(description));
+}
+
+void SamplerRegistry::set_filter(GLenum min_filter, GLenum mag_filter) {
+  min_filter_override = min_filter;
+  mag_filter_override = mag_filter;
+  for (const auto& [description, sampler] : samplers) {
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, min_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, mag_filter);
+  }
+}
+
+size_t SamplerRegistry::size() const {
+  return samplers.size();
+}
+
+void SamplerRegistry::clear() {
+  for (const auto& [description, sampler] : samplers) {
+    glDeleteSamplers(1, &sampler);
+  }
+  samplers.clear();
+}
+
+#endif
@@ -0,0 +1,481 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <optional>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+// Layout of a compiled scene, little endian, every offset from the start of the file:
+//   SceneHeader
+//   SceneMesh, SceneMaterial, SceneTexture and SceneInstance tables
+//   strings, not terminated
+//   per mesh: interleaved float vertices, then uint32 indices, each on a SCENE_ALIGNMENT boundary
+// The tables are read in place and the vertex and index sections are handed to GL as they
+// are mapped, so loading is bounds checks only. Text scenes are compiled by `scene_compiler`.
+const char SCENE_MAGIC[8] {'R', 'O', 'T', 'E', 'S', 'C', 'E', 'N'};
+const uint32_t SCENE_VERSION = 1;
+const uint64_t SCENE_ALIGNMENT = 16;
+const uint32_t SCENE_MAX_ATTRIBUTES = 8;
+const uint32_t SCENE_NONE = 0xFFFFFFFFu;
+
+struct SceneString {
+  uint32_t offset; // from strings_offset
+  uint32_t length;
+};
+
+struct SceneAttribute {
+  uint32_t location;
+  uint32_t components; // floats
+};
+
+struct SceneMesh {
+  SceneString name;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t stride; // bytes per vertex
+  uint32_t attribute_count;
+  SceneAttribute attributes[SCENE_MAX_ATTRIBUTES];
+  uint64_t vertices_offset;
+  uint64_t indices_offset;
+};
+
+struct SceneMaterial {
+  SceneString name;
+  SceneString vertex_shader;   // asset names
+  SceneString fragment_shader;
+  uint32_t first_texture;
+  uint32_t texture_count;
+};
+
+struct SceneTexture {
+  SceneString sampler; // uniform the texture is bound to
+  SceneString asset;
+  uint32_t wrap_s;     // GL enums
+  uint32_t wrap_t;
+};
+
+struct SceneInstance {
+  uint32_t mesh;
+  uint32_t material;  // SCENE_NONE when the instance has none
+  float transform[16]; // column major
+};
+
+struct SceneHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t mesh_count;
+  uint32_t material_count;
+  uint32_t texture_count;
+  uint32_t instance_count;
+  uint32_t reserved;
+  uint64_t meshes_offset;
+  uint64_t materials_offset;
+  uint64_t textures_offset;
+  uint64_t instances_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  uint64_t file_size;
+};
+
+// Builds a compiled scene; used by the `scene_compiler` tool.
+class SceneWriter {
+private:
+  struct Mesh {
+    std::string name;
+    std::vector<SceneAttribute> attributes;
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+  };
+  struct Texture {
+    std::string sampler;
+    std::string asset;
+    uint32_t wrap_s;
+    uint32_t wrap_t;
+  };
+  struct Material {
+    std::string name;
+    std::string vertex_shader;
+    std::string fragment_shader;
+    std::vector<Texture> textures;
+  };
+  std::vector<Mesh> meshes;
+  std::vector<Material> materials;
+  std::vector<SceneInstance> instances;
+public:
+  // returns the mesh's index, or SCENE_NONE (with the reason printed) when its vertices do
+  // not fill whole vertices or an index points past them
+  uint32_t add_mesh(const std::string &name, const std::vector<SceneAttribute> &attributes,
+                    std::vector<float> vertices, std::vector<uint32_t> indices);
+  uint32_t add_material(const std::string &name, const std::string &vertex_shader, const std::string &fragment_shader);
+  void add_texture(uint32_t material, const std::string &sampler, const std::string &asset, uint32_t wrap_s, uint32_t wrap_t);
+  // `material` may be SCENE_NONE; false when either index is out of range
+  bool add_instance(uint32_t mesh, uint32_t material, const float transform[16]);
+  // removes the attributes at `locations` from every vertex of `mesh`, unless that would leave
+  // it none, and returns the vertex bytes saved
+  size_t strip_attributes(uint32_t mesh, const std::vector<uint32_t> &locations);
+  bool write(const std::string &path) const;
+};
+
+// A compiled scene opened with a single mmap, or read in place from an asset. Nothing is
+// parsed or copied: the accessors return spans into the mapping or the asset's bytes,
+// valid until close(). open() checks that every table,
+// string and section lies inside the file; index values are not scanned, the compiler
+// has checked them and reading them all would fault in every index page.
+class SceneFile {
+private:
+  const unsigned char* mapping {nullptr};
+  size_t mapping_size {0};
+  bool mapped {false}; // false when `mapping` points at bytes owned elsewhere
+  const SceneHeader* header {nullptr};
+
+  bool adopt(const unsigned char* bytes, size_t size, bool owned, const std::string &name);
+
+  bool valid() const;
+  bool in_bounds(uint64_t offset, uint64_t size) const;
+  bool valid_string(SceneString string) const;
+  template <typename T>
+  std::span<const T> table(uint64_t offset, uint64_t count) const;
+public:
+  SceneFile() = default;
+  SceneFile(const SceneFile&) = delete;
+  SceneFile& operator=(const SceneFile&) = delete;
+  ~SceneFile();
+
+  bool open(const std::string &path);
+  // `bytes` must outlive the scene and start on an 8-byte boundary, as embedded, packed
+  // and loaded assets do; `name` is only used in errors
+  bool open(std::span<const unsigned char> bytes, const std::string &name);
+  void close();
+  bool is_open() const;
+
+  std::span<const SceneMesh> meshes() const;
+  std::span<const SceneMaterial> materials() const;
+  std::span<const SceneInstance> instances() const;
+  std::span<const SceneTexture> textures(const SceneMaterial &material) const;
+
+  std::span<const float> vertices(const SceneMesh &mesh) const;
+  std::span<const uint32_t> indices(const SceneMesh &mesh) const;
+  std::string_view string(SceneString string) const;
+
+  std::optional<uint32_t> find_mesh(std::string_view name) const;
+  std::optional<uint32_t> find_material(std::string_view name) const;
+};
+
+uint32_t SceneWriter::add_mesh(const std::string &name, const std::vector<SceneAttribute> &attributes,
+                               std::vector<float> vertices, std::vector<uint32_t> indices) {
+  uint32_t components = 0;
+  for (const SceneAttribute& attribute : attributes) {
+    components += attribute.components;
+  }
+  if (attributes.empty() || attributes.size() > SCENE_MAX_ATTRIBUTES || components == 0 || vertices.size() % components != 0) {
+    std::cout << "ERROR::SCENE_WRITER::INVALID_VERTICES " << name << std::endl;
+    return SCENE_NONE;
+  }
+  size_t vertex_count = vertices.size() / components;
+  if (std::any_of(indices.begin(), indices.end(), [&](uint32_t index) { return index >= vertex_count; })) {
+    std::cout << "ERROR::SCENE_WRITER::INDEX_OUT_OF_RANGE " << name << std::endl;
+    return SCENE_NONE;
+  }
+  meshes.push_back({name, attributes, std::move(vertices), std::move(indices)});
+  return meshes.size() - 1;
+}
+
+uint32_t SceneWriter::add_material(const std::string &name, const std::string &vertex_shader, const std::string &fragment_shader) {
+  materials.push_back({name, vertex_shader, fragment_shader, {}});
+  return materials.size() - 1;
+}
+
+void SceneWriter::add_texture(uint32_t material, const std::string &sampler, const std::string &asset, uint32_t wrap_s, uint32_t wrap_t) {
+  materials.at(material).textures.push_back({sampler, asset, wrap_s, wrap_t});
+}
+
+bool SceneWriter::add_instance(uint32_t mesh, uint32_t material, const float transform[16]) {
+  if (mesh >= meshes.size() || (material != SCENE_NONE && material >= materials.size())) {
+    return false;
+  }
+  SceneInstance instance {mesh, material, {}};
+  std::copy_n(transform, 16, instance.transform);
+  instances.push_back(instance);
+  return true;
+}
+
+size_t SceneWriter::strip_attributes(uint32_t mesh, const std::vector<uint32_t> &locations) {
+  Mesh& stripped = meshes.at(mesh);
+  std::vector<SceneAttribute> kept;
+  std::vector<std::pair<uint32_t, uint32_t>> kept_ranges; // source offset and count, in floats
+  uint32_t stride = 0;
+  for (const SceneAttribute& attribute : stripped.attributes) {
+    if (std::find(locations.begin(), locations.end(), attribute.location) == locations.end()) {
+      kept.push_back(attribute);
+      kept_ranges.push_back({stride, attribute.components});
+    }
+    stride += attribute.components;
+  }
+  if (kept.empty() || kept.size() == stripped.attributes.size()) {
+    return 0;
+  }
+
+  std::vector<float> vertices;
+  for (size_t vertex = 0; vertex < stripped.vertices.size(); vertex += stride) {
+    for (const auto& [offset, count] : kept_ranges) {
+      auto first = stripped.vertices.begin() + vertex + offset;
+      vertices.insert(vertices.end(), first, first + count);
+    }
+  }
+  size_t saved = (stripped.vertices.size() - vertices.size()) * sizeof(float);
+  stripped.attributes = std::move(kept);
+  stripped.vertices = std::move(vertices);
+  return saved;
+}
+
+bool SceneWriter::write(const std::string &path) const {
+  std::string strings;
+  auto add_string = [&](const std::string &string) {
+    SceneString reference {(uint32_t)strings.size(), (uint32_t)string.size()};
+    strings += string;
+    return reference;
+  };
+
+  std::vector<SceneMesh> mesh_table;
+  std::vector<SceneMaterial> material_table;
+  std::vector<SceneTexture> texture_table;
+  for (const Mesh& mesh : meshes) {
+    SceneMesh entry {};
+    entry.name = add_string(mesh.name);
+    entry.attribute_count = mesh.attributes.size();
+    std::copy(mesh.attributes.begin(), mesh.attributes.end(), entry.attributes);
+    for (const SceneAttribute& attribute : mesh.attributes) {
+      entry.stride += attribute.components * sizeof(float);
+    }
+    entry.vertex_count = mesh.vertices.size() * sizeof(float) / entry.stride;
+    entry.index_count = mesh.indices.size();
+    mesh_table.push_back(entry);
+  }
+  for (const Material& material : materials) {
+    SceneMaterial entry {add_string(material.name), add_string(material.vertex_shader), add_string(material.fragment_shader),
+                         (uint32_t)texture_table.size(), (uint32_t)material.textures.size()};
+    for (const Texture& texture : material.textures) {
+      texture_table.push_back({add_string(texture.sampler), add_string(texture.asset), texture.wrap_s, texture.wrap_t});
+    }
+    material_table.push_back(entry);
+  }
+
+  std::vector<unsigned char> scene(sizeof(SceneHeader));
+  auto append = [&](const void* bytes, size_t size) {
+    scene.resize((scene.size() + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT);
+    uint64_t offset = scene.size();
+    scene.insert(scene.end(), (const unsigned char*)bytes, (const unsigned char*)bytes + size);
+    return offset;
+  };
+  SceneHeader header {};
+  std::memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+  header.version = SCENE_VERSION;
+  header.mesh_count = mesh_table.size();
+  header.material_count = material_table.size();
+  header.texture_count = texture_table.size();
+  header.instance_count = instances.size();
+  // the tables go in first so their offsets are known before they are filled in
+  header.meshes_offset = append(mesh_table.data(), mesh_table.size() * sizeof(SceneMesh));
+  header.materials_offset = append(material_table.data(), material_table.size() * sizeof(SceneMaterial));
+  header.textures_offset = append(texture_table.data(), texture_table.size() * sizeof(SceneTexture));
+  header.instances_offset = append(instances.data(), instances.size() * sizeof(SceneInstance));
+  header.strings_offset = append(strings.data(), strings.size());
+  header.strings_size = strings.size();
+  for (size_t i = 0; i < meshes.size(); i++) {
+    mesh_table[i].vertices_offset = append(meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(float));
+    mesh_table[i].indices_offset = append(meshes[i].indices.data(), meshes[i].indices.size() * sizeof(uint32_t));
+  }
+  std::copy_n((const unsigned char*)mesh_table.data(), mesh_table.size() * sizeof(SceneMesh), &scene[header.meshes_offset]);
+  header.file_size = scene.size();
+  std::memcpy(scene.data(), &header, sizeof(header));
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write((const char*)scene.data(), scene.size());
+  return (bool)file;
+}
+
+SceneFile::~SceneFile() {
+  close();
+}
+
+bool SceneFile::open(const std::string &path) {
+  close();
+  int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (descriptor == -1 || fstat(descriptor, &status) == -1 || status.st_size < (off_t)sizeof(SceneHeader)) {
+    std::cout << "ERROR::SCENE_FILE::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+    if (descriptor != -1) {
+      ::close(descriptor);
+    }
+    return false;
+  }
+  void* memory = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  ::close(descriptor);
+  if (memory == MAP_FAILED) {
+    std::cout << "ERROR::SCENE_FILE::MMAP_FAILED " << path << std::endl;
+    return false;
+  }
+  if (!adopt((const unsigned char*)memory, status.st_size, true, path)) {
+    return false;
+  }
+  // everything in a scene is uploaded right after loading
+  madvise((void*)mapping, mapping_size, MADV_WILLNEED);
+  return true;
+}
+
+bool SceneFile::open(std::span<const unsigned char> bytes, const std::string &name) {
+  close();
+  // the tables are read in place, so they need their natural alignment
+  if (bytes.size() < sizeof(SceneHeader) || (uintptr_t)bytes.data() % alignof(SceneHeader) != 0) {
+    std::cout << "ERROR::SCENE_FILE::INVALID " << name << std::endl;
+    return false;
+  }
+  return adopt(bytes.data(), bytes.size(), false, name);
+}
+
+bool SceneFile::adopt(const unsigned char* bytes, size_t size, bool owned, const std::string &name) {
+  mapping = bytes;
+  mapping_size = size;
+  mapped = owned;
+  header = (const SceneHeader*)mapping;
+  if (!valid()) {
+    std::cout << "ERROR::SCENE_FILE::INVALID " << name << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool SceneFile::in_bounds(uint64_t offset, uint64_t size) const {
+  return offset <= mapping_size && size <= mapping_size - offset;
+}
+
+bool SceneFile::valid_string(SceneString string) const {
+  return (uint64_t)string.offset + string.length <= header->strings_size;
+}
+
+bool SceneFile::valid() const {
+  auto valid_table = [&](uint64_t offset, uint32_t count, size_t size, size_t alignment) {
+    return offset % alignment == 0 && in_bounds(offset, (uint64_t)count * size);
+  };
+  if (std::memcmp(header->magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0 || header->version != SCENE_VERSION ||
+      header->file_size != mapping_size ||
+      !valid_table(header->meshes_offset, header->mesh_count, sizeof(SceneMesh), alignof(SceneMesh)) ||
+      !valid_table(header->materials_offset, header->material_count, sizeof(SceneMaterial), alignof(SceneMaterial)) ||
+      !valid_table(header->textures_offset, header->texture_count, sizeof(SceneTexture), alignof(SceneTexture)) ||
+      !valid_table(header->instances_offset, header->instance_count, sizeof(SceneInstance), alignof(SceneInstance)) ||
+      !in_bounds(header->strings_offset, header->strings_size)) {
+    return false;
+  }
+
+  for (const SceneMesh& mesh : meshes()) {
+    uint32_t components = 0;
+    for (uint32_t i = 0; i < std::min(mesh.attribute_count, SCENE_MAX_ATTRIBUTES); i++) {
+      components += mesh.attributes[i].components;
+    }
+    if (!valid_string(mesh.name) || mesh.attribute_count == 0 || mesh.attribute_count > SCENE_MAX_ATTRIBUTES ||
+        mesh.stride == 0 || mesh.stride != components * sizeof(float) ||
+        !valid_table(mesh.vertices_offset, mesh.vertex_count, mesh.stride, alignof(float)) ||
+        !valid_table(mesh.indices_offset, mesh.index_count, sizeof(uint32_t), alignof(uint32_t))) {
+      return false;
+    }
+  }
+  for (const SceneMaterial& material : materials()) {
+    if (!valid_string(material.name) || !valid_string(material.vertex_shader) || !valid_string(material.fragment_shader) ||
+        material.first_texture > header->texture_count || material.texture_count > header->texture_count - material.first_texture) {
+      return false;
+    }
+  }
+  for (const SceneTexture& texture : table<SceneTexture>(header->textures_offset, header->texture_count)) {
+    if (!valid_string(texture.sampler) || !valid_string(texture.asset)) {
+      return false;
+    }
+  }
+  for (const SceneInstance& instance : instances()) {
+    if (instance.mesh >= header->mesh_count || (instance.material != SCENE_NONE && instance.material >= header->material_count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SceneFile::close() {
+  if (mapping && mapped) {
+    munmap((void*)mapping, mapping_size);
+  }
+  mapping = nullptr;
+  mapping_size = 0;
+  mapped = false;
+  header = nullptr;
+}
+
+bool SceneFile::is_open() const {
+  return mapping != nullptr;
+}
+
+template <typename T>
+std::span<const T> SceneFile::table(uint64_t offset, uint64_t count) const {
+  return mapping ? std::span<const T>((const T*)(mapping + offset), count) : std::span<const T>();
+}
+
+std::span<const SceneMesh> SceneFile::meshes() const {
+  return header ? table<SceneMesh>(header->meshes_offset, header->mesh_count) : std::span<const SceneMesh>();
+}
+
+std::span<const SceneMaterial> SceneFile::materials() const {
+  return header ? table<SceneMaterial>(header->materials_offset, header->material_count) : std::span<const SceneMaterial>();
+}
+
+std::span<const SceneInstance> SceneFile::instances() const {
+  return header ? table<SceneInstance>(header->instances_offset, header->instance_count) : std::span<const SceneInstance>();
+}
+
+std::span<const SceneTexture> SceneFile::textures(const SceneMaterial &material) const {
+  return table<SceneTexture>(header->textures_offset, header->texture_count).subspan(material.first_texture, material.texture_count);
+}
+
+std::span<const float> SceneFile::vertices(const SceneMesh &mesh) const {
+  return table<float>(mesh.vertices_offset, (uint64_t)mesh.vertex_count * mesh.stride / sizeof(float));
+}
+
+std::span<const uint32_t> SceneFile::indices(const SceneMesh &mesh) const {
+  return table<uint32_t>(mesh.indices_offset, mesh.index_count);
+}
+
+std::string_view SceneFile::string(SceneString string) const {
+  return std::string_view((const char*)mapping + header->strings_offset + string.offset, string.length);
+}
+
+std::optional<uint32_t> SceneFile::find_mesh(std::string_view name) const {
+  std::span<const SceneMesh> all = meshes();
+  for (uint32_t i = 0; i < all.size(); i++) {
+    if (string(all[i].name) == name) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<uint32_t> SceneFile::find_material(std::string_view name) const {
+  std::span<const SceneMaterial> all = materials();
+  for (uint32_t i = 0; i < all.size(); i++) {
+    if (string(all[i].name) == name) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SCENE_GEOMETRY_H
+#define SCENE_GEOMETRY_H
+
+#include <glad/glad.h>
+#include <shader.h>
+#include <scene_file.h>
+
+#include <vector>
+#include <algorithm>
+
+struct SceneMeshBuffers {
+  unsigned int vertex_array;
+  unsigned int vertex_buffer;
+  unsigned int element_buffer;
+  int index_count;
+};
+
+// GL buffers for every mesh of a scene, filled from the mapped sections themselves: no
+// staging copy, no re-packing. scene_compiler has already dropped the attributes none of a
+// mesh's materials read; any others the program does not read are only left disabled.
+class SceneGeometry {
+private:
+  std::vector<SceneMeshBuffers> buffers;
+  size_t bytes {0};
+public:
+  SceneGeometry(const SceneFile &scene, const Shader &shader);
+  SceneGeometry(const SceneGeometry&) = delete;
+  SceneGeometry& operator=(const SceneGeometry&) = delete;
+  ~SceneGeometry();
+
+  const SceneMeshBuffers& mesh(uint32_t index) const;
+  size_t uploaded_bytes() const;
+
+  // points the bound VAO at the attributes of `mesh` in the bound GL_ARRAY_BUFFER,
+  // enabling only those at `active` locations
+  static void set_attributes(const SceneMesh &mesh, const std::vector<unsigned int> &active);
+};
+
+SceneGeometry::SceneGeometry(const SceneFile &scene, const Shader &shader) {
+  std::vector<unsigned int> active = shader.active_attribute_locations();
+  int previous_vertex_array;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+
+  for (const SceneMesh& mesh : scene.meshes()) {
+    std::span<const float> vertices = scene.vertices(mesh);
+    std::span<const uint32_t> indices = scene.indices(mesh);
+    SceneMeshBuffers mesh_buffers {0, 0, 0, (int)indices.size()};
+    glGenVertexArrays(1, &mesh_buffers.vertex_array);
+    glGenBuffers(1, &mesh_buffers.vertex_buffer);
+    glGenBuffers(1, &mesh_buffers.element_buffer);
+    glBindVertexArray(mesh_buffers.vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh_buffers.vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size_bytes(), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_buffers.element_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_bytes(), indices.data(), GL_STATIC_DRAW);
+    bytes += vertices.size_bytes() + indices.size_bytes();
+
+    set_attributes(mesh, active);
+    buffers.push_back(mesh_buffers);
+  }
+  glBindVertexArray(previous_vertex_array);
+}
+
+void SceneGeometry::set_attributes(const SceneMesh &mesh, const std::vector<unsigned int> &active) {
+  size_t offset = 0;
+  for (uint32_t i = 0; i < mesh.attribute_count; i++) {
+    const SceneAttribute& attribute = mesh.attributes[i];
+    if (std::find(active.begin(), active.end(), attribute.location) != active.end()) {
+      glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE, mesh.stride, (void*)offset);
+      glEnableVertexAttribArray(attribute.location);
+    }
+    offset += attribute.components * sizeof(float);
+  }
+}
+
+SceneGeometry::~SceneGeometry() {
+  for (const SceneMeshBuffers& mesh_buffers : buffers) {
+    glDeleteVertexArrays(1, &mesh_buffers.vertex_array);
+    glDeleteBuffers(1, &mesh_buffers.vertex_buffer);
+    glDeleteBuffers(1, &mesh_buffers.element_buffer);
+  }
+}
+
+const SceneMeshBuffers& SceneGeometry::mesh(uint32_t index) const {
+  return buffers.at(index);
+}
+
+size_t SceneGeometry::uploaded_bytes() const {
+  return bytes;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef SEPARATE_SHADER_OBJECTS_H
+#define SEPARATE_SHADER_OBJECTS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad is generated for core 3.3 without extensions, so the
+// ARB_separate_shader_objects entry points (core in 4.1) are loaded by hand.
+
+#define SSO_VERTEX_SHADER_BIT 0x00000001
+#define SSO_FRAGMENT_SHADER_BIT 0x00000002
+#define SSO_PROGRAM_SEPARABLE 0x8258
+
+typedef void (APIENTRYP SSO_PROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP SSO_GENPROGRAMPIPELINES)(GLsizei n, GLuint* pipelines);
+typedef void (APIENTRYP SSO_DELETEPROGRAMPIPELINES)(GLsizei n, const GLuint* pipelines);
+typedef void (APIENTRYP SSO_BINDPROGRAMPIPELINE)(GLuint pipeline);
+typedef void (APIENTRYP SSO_USEPROGRAMSTAGES)(GLuint pipeline, GLbitfield stages, GLuint program);
+typedef void (APIENTRYP SSO_PROGRAMUNIFORM1I)(GLuint program, GLint location, GLint v0);
+typedef void (APIENTRYP SSO_PROGRAMUNIFORM1F)(GLuint program, GLint location, GLfloat v0);
+typedef void (APIENTRYP SSO_PROGRAMUNIFORM4F)(GLuint program, GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+typedef void (APIENTRYP SSO_PROGRAMUNIFORMMATRIX4FV)(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+
+struct SeparateShaderObjects {
+  SSO_PROGRAMPARAMETERI program_parameter_i {nullptr};
+  SSO_GENPROGRAMPIPELINES gen_program_pipelines {nullptr};
+  SSO_DELETEPROGRAMPIPELINES delete_program_pipelines {nullptr};
+  SSO_BINDPROGRAMPIPELINE bind_program_pipeline {nullptr};
+  SSO_USEPROGRAMSTAGES use_program_stages {nullptr};
+  SSO_PROGRAMUNIFORM1I program_uniform_1i {nullptr};
+  SSO_PROGRAMUNIFORM1F program_uniform_1f {nullptr};
+  SSO_PROGRAMUNIFORM4F program_uniform_4f {nullptr};
+  SSO_PROGRAMUNIFORMMATRIX4FV program_uniform_matrix_4fv {nullptr};
+
+  // returns true when the context exposes separable programs (4.1+ or the ARB extension)
+  bool load(GLADloadproc load_proc);
+};
+
+inline SeparateShaderObjects sso;
+
+bool SeparateShaderObjects::load(GLADloadproc load_proc) {
+  int major;
+  int minor;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  bool supported = major > 4 || (major == 4 && minor >= 1);
+
+  int number_of_extensions;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &number_of_extensions);
+  for (int i = 0; !supported && i < number_of_extensions; i++) {
+    const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    supported = name && std::strcmp(name, "GL_ARB_separate_shader_objects") == 0;
+  }
+  if (!supported) {
+    return false;
+  }
+
+  program_parameter_i = (SSO_PROGRAMPARAMETERI)load_proc("glProgramParameteri");
+  gen_program_pipelines = (SSO_GENPROGRAMPIPELINES)load_proc("glGenProgramPipelines");
+  delete_program_pipelines = (SSO_DELETEPROGRAMPIPELINES)load_proc("glDeleteProgramPipelines");
+  bind_program_pipeline = (SSO_BINDPROGRAMPIPELINE)load_proc("glBindProgramPipeline");
+  use_program_stages = (SSO_USEPROGRAMSTAGES)load_proc("glUseProgramStages");
+  program_uniform_1i = (SSO_PROGRAMUNIFORM1I)load_proc("glProgramUniform1i");
+  program_uniform_1f = (SSO_PROGRAMUNIFORM1F)load_proc("glProgramUniform1f");
+  program_uniform_4f = (SSO_PROGRAMUNIFORM4F)load_proc("glProgramUniform4f");
+  program_uniform_matrix_4fv = (SSO_PROGRAMUNIFORMMATRIX4FV)load_proc("glProgramUniformMatrix4fv");
+
+  return program_parameter_i && gen_program_pipelines && delete_program_pipelines &&
+         bind_program_pipeline && use_program_stages &&
+         program_uniform_1i && program_uniform_1f && program_uniform_4f && program_uniform_matrix_4fv;
+}
+
+#endif
@@ -2,53 +2,164 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <separate_shader_objects.h>
+#include <assets.h>
+#include <shader_reflection.h>
 
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <map>
+#include <set>
+#include <vector>
 
 class Shader {
 private:
   const short INFO_LOG_SIZE = 512;
-  unsigned int ID;
+  unsigned int ID {0};
+
+  // separable backend: ID names a program pipeline and each stage is its own program. Stage
+  // shaders are compiled once per asset name and shared, but every Shader links its own stage
+  // programs from them, since uniforms live on the programs and must not leak between Shaders
+  struct CompiledStage {
+    unsigned int shader;
+    int references;
+  };
+  inline static std::map<std::pair<GLenum, std::string>, CompiledStage> compiled_stages;
+  inline static bool separable_enabled {false};
+  bool separable {false};
+  unsigned int vertex_program {0};
+  unsigned int fragment_program {0};
+  std::string vertex_path;
+  std::string fragment_path;
+
+  unsigned int stage_program(GLenum type, const std::string &path) const;
+  // drops this Shader's reference to the compiled stage, deleting it once no Shader uses it
+  static void release_stage(GLenum type, const std::string &path);
+  // compiles both stages and links them into one conventional program
+  unsigned int link_program(const char* vertex_path, const char* fragment_path) const;
+  // the source a compiled stage was built from
+  static std::string stage_source(GLenum type, const std::string &path);
+  static std::vector<unsigned int> attribute_locations(unsigned int program, const std::set<std::string> &skipped = {});
 public:
+  // switches every Shader constructed afterwards to the separable backend when supported
+  static bool enable_separable(GLADloadproc load_proc);
+
   Shader(const char* vertex_path, const char* fragment_path);
+  Shader(const Shader&) = delete;
+  Shader& operator=(const Shader&) = delete;
+  ~Shader();
 
   void use();
+  // deletes the program or pipeline while the context is still current; the destructor calls it
+  void clear();
+
+  // locations of the vertex attributes the program actually reads; inputs that only feed
+  // interpolants the fragment stage ignores do not show up here
+  std::vector<unsigned int> active_attribute_locations() const;
 
   void set_bool(const std::string &name, bool value) const;
   void set_int(const std::string &name, int value) const;
   void set_float(const std::string &name, float value) const;
   void set_float_sin(const std::string name, float rgba[]) const;
+  // `matrix` holds 16 floats, column major
+  void set_mat4(const std::string &name, const float* matrix) const;
 };
 
-Shader::Shader(const char* vertex_path, const char* fragment_path) {
-  std::string vertex_code;
-  std::string fragment_code;
-  std::ifstream vertex_shader_file;
-  std::ifstream fragment_shader_file;
+bool Shader::enable_separable(GLADloadproc load_proc) {
+  separable_enabled = sso.load(load_proc);
+  return separable_enabled;
+}
+
+unsigned int Shader::stage_program(GLenum type, const std::string &path) const {
+  auto key = std::make_pair(type, path);
+  auto found = compiled_stages.find(key);
+  if (found == compiled_stages.end()) {
+    std::string code(assets.get(path).text());
+    const char* source = code.c_str();
+
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    int success;
+    char info_log[INFO_LOG_SIZE];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+      glGetShaderInfoLog(shader, INFO_LOG_SIZE, NULL, info_log);
+      std::cout << "ERROR::SHADER::SEPARABLE::COMPILATION_FAILED\n" << info_log << std::endl;
+    }
+    found = compiled_stages.emplace(key, CompiledStage {shader, 0}).first;
+  }
+  found->second.references++;
+
+  // linking a single compiled stage is cheap next to compiling it, and gives this Shader
+  // uniform storage of its own
+  unsigned int program = glCreateProgram();
+  sso.program_parameter_i(program, SSO_PROGRAM_SEPARABLE, GL_TRUE);
+  glAttachShader(program, found->second.shader);
+  glLinkProgram(program);
+  glDetachShader(program, found->second.shader);
+
+  int success;
+  char info_log[INFO_LOG_SIZE];
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    glGetProgramInfoLog(program, INFO_LOG_SIZE, NULL, info_log);
+    std::cout << "ERROR::SHADER::SEPARABLE::LINKING_FAILED\n" << info_log << std::endl;
+  }
+  return program;
+}
 
-  vertex_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  fragment_shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  try {
-    vertex_shader_file.open(vertex_path);
-    fragment_shader_file.open(fragment_path);
-    std::stringstream vertex_shader_stream;
-    std::stringstream fragment_shader_stream;
+void Shader::release_stage(GLenum type, const std::string &path) {
+  auto found = compiled_stages.find(std::make_pair(type, path));
+  if (found == compiled_stages.end() || --found->second.references > 0) {
+    return;
+  }
+  glDeleteShader(found->second.shader);
+  compiled_stages.erase(found);
+}
 
-    vertex_shader_stream << vertex_shader_file.rdbuf();
-    fragment_shader_stream << fragment_shader_file.rdbuf();
+Shader::Shader(const char* vertex_path, const char* fragment_path) {
+  if (separable_enabled) {
+    separable = true;
+    this->vertex_path = vertex_path;
+    this->fragment_path = fragment_path;
+    vertex_program = stage_program(GL_VERTEX_SHADER, vertex_path);
+    fragment_program = stage_program(GL_FRAGMENT_SHADER, fragment_path);
+    sso.gen_program_pipelines(1, &ID);
+    sso.use_program_stages(ID, SSO_VERTEX_SHADER_BIT, vertex_program);
+    sso.use_program_stages(ID, SSO_FRAGMENT_SHADER_BIT, fragment_program);
+    return;
+  }
+  ID = link_program(vertex_path, fragment_path);
+}
 
-    vertex_shader_file.close();
-    fragment_shader_file.close();
+Shader::~Shader() {
+  clear();
+}
 
-    vertex_code = vertex_shader_stream.str();
-    fragment_code = fragment_shader_stream.str();
+void Shader::clear() {
+  if (ID == 0) {
+    return;
   }
-  catch (std::ifstream::failure e) {
-    std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+  if (separable) {
+    sso.delete_program_pipelines(1, &ID);
+    glDeleteProgram(vertex_program);
+    glDeleteProgram(fragment_program);
+    release_stage(GL_VERTEX_SHADER, vertex_path);
+    release_stage(GL_FRAGMENT_SHADER, fragment_path);
+    vertex_program = 0;
+    fragment_program = 0;
   }
+  else {
+    glDeleteProgram(ID);
+  }
+  ID = 0;
+}
+
+unsigned int Shader::link_program(const char* vertex_path, const char* fragment_path) const {
+  // sources come from the embedded asset table, or from disk during development
+  std::string vertex_code(assets.get(vertex_path).text());
+  std::string fragment_code(assets.get(fragment_path).text());
   const char* vertex_shader_source = vertex_code.c_str();
   const char* fragment_shader_source = fragment_code.c_str();
 
@@ -74,39 +185,135 @@ Shader::Shader(const char* vertex_path, const char* fragment_path) {
     glGetShaderInfoLog(fragment_shader, INFO_LOG_SIZE, NULL, info_log);
     std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << info_log << std::endl;
   }
-  ID = glCreateProgram();
-  glAttachShader(ID, vertex_shader);
-  glAttachShader(ID, fragment_shader);
-  glLinkProgram(ID);
+  unsigned int program = glCreateProgram();
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glLinkProgram(program);
 
-  glGetProgramiv(ID, GL_LINK_STATUS, &success);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
   if (!success) {
-    glGetProgramInfoLog(ID, INFO_LOG_SIZE, NULL, info_log);
+    glGetProgramInfoLog(program, INFO_LOG_SIZE, NULL, info_log);
     std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << info_log << std::endl;
   }
 
   glDeleteShader(vertex_shader);
   glDeleteShader(fragment_shader);
+  return program;
 }
 
 void Shader::use() {
+  if (separable) {
+    glUseProgram(0); // a bound program takes precedence over the pipeline
+    sso.bind_program_pipeline(ID);
+    return;
+  }
   glUseProgram(ID);
 }
 
+std::vector<unsigned int> Shader::active_attribute_locations() const {
+  if (!separable) {
+    return attribute_locations(ID); // the linker drops interpolants nothing reads
+  }
+  // a separable vertex stage is linked alone and keeps every output, and a separable fragment
+  // stage reports the inputs it declares whether it reads them or not, so the attributes that
+  // only feed unread interpolants are found in the stage sources rather than by linking the pair
+  std::set<std::string> unread = ShaderReflection::unread_inputs(stage_source(GL_VERTEX_SHADER, vertex_path),
+                                                                 stage_source(GL_FRAGMENT_SHADER, fragment_path));
+  return attribute_locations(vertex_program, unread);
+}
+
+std::string Shader::stage_source(GLenum type, const std::string &path) {
+  auto found = compiled_stages.find(std::make_pair(type, path));
+  if (found == compiled_stages.end()) {
+    return {};
+  }
+  int length;
+  glGetShaderiv(found->second.shader, GL_SHADER_SOURCE_LENGTH, &length);
+  std::string source(length, '\0');
+  glGetShaderSource(found->second.shader, length, &length, source.data());
+  source.resize(length);
+  return source;
+}
+
+std::vector<unsigned int> Shader::attribute_locations(unsigned int program, const std::set<std::string> &skipped) {
+  int count;
+  int max_name_length;
+  glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+  glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_name_length);
+
+  std::vector<unsigned int> locations;
+  std::vector<char> name(max_name_length + 1, '\0');
+  for (int i = 0; i < count; i++) {
+    int size;
+    GLenum type;
+    glGetActiveAttrib(program, i, max_name_length, NULL, &size, &type, name.data());
+    if (skipped.count(name.data())) {
+      continue;
+    }
+    int location = glGetAttribLocation(program, name.data());
+    if (location != -1) { // built-ins like gl_VertexID have no location
+      locations.push_back(location);
+    }
+  }
+  return locations;
+}
+
+// uniforms of a separable pipeline live on the stage programs, so set them on every stage declaring them
+
 void Shader::set_bool(const std::string &name, bool value) const {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), int(value));
+  set_int(name, int(value));
 }
 
 void Shader::set_int(const std::string &name, int value) const {
+  if (separable) {
+    for (unsigned int program : {vertex_program, fragment_program}) {
+      int location = glGetUniformLocation(program, name.c_str());
+      if (location != -1) {
+        sso.program_uniform_1i(program, location, value);
+      }
+    }
+    return;
+  }
   glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 }
 
 void Shader::set_float(const std::string &name, float value) const {
+  if (separable) {
+    for (unsigned int program : {vertex_program, fragment_program}) {
+      int location = glGetUniformLocation(program, name.c_str());
+      if (location != -1) {
+        sso.program_uniform_1f(program, location, value);
+      }
+    }
+    return;
+  }
   glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 }
 
 void Shader::set_float_sin(const std::string name, float rgba[]) const {
+  if (separable) {
+    for (unsigned int program : {vertex_program, fragment_program}) {
+      int location = glGetUniformLocation(program, name.c_str());
+      if (location != -1) {
+        sso.program_uniform_4f(program, location, rgba[0], rgba[1], rgba[2], rgba[3]);
+      }
+    }
+    return;
+  }
   glUniform4f(glGetUniformLocation(ID, name.c_str()), rgba[0], rgba[1], rgba[2], rgba[3]);
 }
 
+void Shader::set_mat4(const std::string &name, const float* matrix) const {
+  if (separable) {
+    for (unsigned int program : {vertex_program, fragment_program}) {
+      int location = glGetUniformLocation(program, name.c_str());
+      if (location != -1) {
+        sso.program_uniform_matrix_4fv(program, location, 1, GL_FALSE, matrix);
+      }
+    }
+    return;
+  }
+  glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, matrix);
+}
+
 #endif
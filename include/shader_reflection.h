@@ -0,0 +1,158 @@
+#ifndef SHADER_REFLECTION_H
+#define SHADER_REFLECTION_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+// What a vertex and fragment stage read of each other, found in their GLSL sources, so it
+// needs neither a context nor a link of the pair. It is conservative: a name is only
+// reported unread when every statement using it computes an output nothing reads.
+class ShaderReflection {
+private:
+  struct Statement {
+    // the variable the statement assigns, empty when it assigns nothing
+    std::string target;
+    std::vector<std::string> names;
+    // the `layout (location = N)` of a declaration, -1 without one
+    int location {-1};
+  };
+
+  // the statements of a source split at `;`, `{` and `}`, with comments and preprocessor
+  // lines dropped, each as the identifiers it mentions in order
+  static std::vector<Statement> statements(std::string_view source);
+  // interface variables and uniforms are declared, not computed
+  static bool is_declaration(const Statement &statement);
+public:
+  // names the vertex stage only uses to compute outputs the fragment stage never reads
+  static std::set<std::string> unread_inputs(std::string_view vertex_source, std::string_view fragment_source);
+  // the vertex inputs declared with an explicit location, by name
+  static std::map<std::string, unsigned int> attribute_locations(std::string_view vertex_source);
+};
+
+std::vector<ShaderReflection::Statement> ShaderReflection::statements(std::string_view source) {
+  std::vector<Statement> result(1);
+  size_t i = 0;
+  while (i < source.size()) {
+    char c = source[i];
+    if (source.compare(i, 2, "//") == 0 || c == '#') {
+      i = source.find('\n', i);
+      continue;
+    }
+    if (source.compare(i, 2, "/*") == 0) {
+      i = source.find("*/", i);
+      i = i == std::string_view::npos ? i : i + 2;
+      continue;
+    }
+    if (c == ';' || c == '{' || c == '}') {
+      result.emplace_back();
+    }
+    else if (std::isalpha((unsigned char)c) || c == '_') {
+      size_t end = i;
+      while (end < source.size() && (std::isalnum((unsigned char)source[end]) || source[end] == '_')) {
+        end++;
+      }
+      result.back().names.emplace_back(source.substr(i, end - i));
+      i = end;
+      if (result.back().names.back() == "location") {
+        // `location = N`, kept apart from the assignments below
+        while (i < source.size() && (std::isspace((unsigned char)source[i]) || source[i] == '=')) {
+          i++;
+        }
+        std::string digits;
+        while (i < source.size() && std::isdigit((unsigned char)source[i])) {
+          digits += source[i++];
+        }
+        result.back().location = digits.empty() ? -1 : std::atoi(digits.c_str());
+      }
+      continue;
+    }
+    else if (c == '=' && source.compare(i, 2, "==") != 0 && (i == 0 || !std::strchr("=!<>", source[i - 1]))) {
+      // `a = b`, `a.xy = b` and `a += b` all write a; the first name is the target
+      Statement& statement = result.back();
+      if (statement.target.empty() && !statement.names.empty()) {
+        statement.target = statement.names[0];
+      }
+    }
+    i++;
+  }
+  return result;
+}
+
+bool ShaderReflection::is_declaration(const Statement &statement) {
+  for (const std::string& name : statement.names) {
+    if (name == "in" || name == "out" || name == "uniform") {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::set<std::string> ShaderReflection::unread_inputs(std::string_view vertex_source, std::string_view fragment_source) {
+  std::set<std::string> read;
+  for (const Statement& statement : statements(fragment_source)) {
+    if (!is_declaration(statement)) {
+      read.insert(statement.names.begin(), statement.names.end());
+    }
+  }
+
+  // outputs the fragment stage ignores, and that the vertex stage does not read back either
+  std::vector<Statement> vertex = statements(vertex_source);
+  std::set<std::string> unread_outputs;
+  for (const Statement& statement : vertex) {
+    bool output = false;
+    for (const std::string& name : statement.names) {
+      output = output || name == "out";
+    }
+    if (output && !read.count(statement.names.back())) {
+      unread_outputs.insert(statement.names.back());
+    }
+  }
+  for (const Statement& statement : vertex) {
+    if (is_declaration(statement)) {
+      continue;
+    }
+    for (size_t i = statement.target.empty() ? 0 : 1; i < statement.names.size(); i++) {
+      unread_outputs.erase(statement.names[i]);
+    }
+  }
+
+  // a name is unread when every statement using it computes one of those outputs
+  std::set<std::string> feeding;
+  std::set<std::string> needed;
+  for (const Statement& statement : vertex) {
+    if (is_declaration(statement)) {
+      continue;
+    }
+    std::set<std::string>& names = unread_outputs.count(statement.target) ? feeding : needed;
+    names.insert(statement.names.begin(), statement.names.end());
+  }
+  std::set<std::string> unread;
+  for (const std::string& name : feeding) {
+    if (!needed.count(name)) {
+      unread.insert(name);
+    }
+  }
+  return unread;
+}
+
+std::map<std::string, unsigned int> ShaderReflection::attribute_locations(std::string_view vertex_source) {
+  std::map<std::string, unsigned int> locations;
+  for (const Statement& statement : statements(vertex_source)) {
+    bool input = false;
+    for (const std::string& name : statement.names) {
+      input = input || name == "in";
+    }
+    if (input && statement.location >= 0) {
+      locations[statement.names.back()] = statement.location;
+    }
+  }
+  return locations;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef SHADER_WARMUP_H
+#define SHADER_WARMUP_H
+
+#include <glad/glad.h>
+#include <shader.h>
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+// Drivers often finish compiling a program on its first draw, once the vertex and
+// render target formats are known. Drawing every combination offscreen at load
+// moves that hitch out of the first real frame.
+class ShaderWarmup {
+private:
+  const int TARGET_SIZE = 4;
+  std::vector<Shader*> programs;
+  std::vector<unsigned int> vertex_arrays;
+  std::vector<GLenum> target_formats;
+public:
+  void add_program(Shader& shader);
+  // the vertex array must source at least three vertices
+  void add_vertex_format(unsigned int vertex_array);
+  // normalized or float color-renderable formats only
+  void add_target_format(GLenum internal_format);
+
+  // draws every program x vertex format x target format combination, returns milliseconds spent
+  double run();
+};
+
+void ShaderWarmup::add_program(Shader& shader) {
+  programs.push_back(&shader);
+}
+
+void ShaderWarmup::add_vertex_format(unsigned int vertex_array) {
+  vertex_arrays.push_back(vertex_array);
+}
+
+void ShaderWarmup::add_target_format(GLenum internal_format) {
+  target_formats.push_back(internal_format);
+}
+
+double ShaderWarmup::run() {
+  auto start = std::chrono::steady_clock::now();
+
+  int viewport[4];
+  int previous_vertex_array;
+  int previous_framebuffer;
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+
+  unsigned int framebuffer;
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+
+  for (GLenum format : target_formats) {
+    unsigned int target;
+    glGenTextures(1, &target);
+    glBindTexture(GL_TEXTURE_2D, target);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, TARGET_SIZE, TARGET_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cout << "ERROR::SHADER_WARMUP::FRAMEBUFFER_INCOMPLETE for format " << format << std::endl;
+    }
+    else {
+      for (Shader* shader : programs) {
+        shader->use();
+        for (unsigned int vertex_array : vertex_arrays) {
+          glBindVertexArray(vertex_array);
+          glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+      }
+    }
+
+    glDeleteTextures(1, &target);
+  }
+  glFinish();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+  glDeleteFramebuffers(1, &framebuffer);
+  glBindVertexArray(previous_vertex_array);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
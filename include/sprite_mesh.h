@@ -0,0 +1,172 @@
+#ifndef SPRITE_MESH_H
+#define SPRITE_MESH_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// convex polygon around the visible texels of a sprite, as a triangle fan
+struct SpriteMesh {
+  std::vector<float> vertices;        // u, v pairs in [0, 1], v = 1 at the top row
+  std::vector<unsigned int> indices;
+  float coverage;                     // area relative to the full quad
+};
+
+// Replaces a sprite's full quad by a tight convex hull of its non-transparent texels,
+// so fully transparent corners are no longer rasterized. The hull is then reduced to
+// at most `max_vertices` by repeatedly merging the edge whose removal adds the least
+// area (extending both neighbouring edges until they meet), which keeps every
+// visible texel inside.
+class SpriteMeshGenerator {
+private:
+  struct Point {
+    double x;
+    double y;
+  };
+  int max_vertices;
+  unsigned char alpha_threshold;
+
+  static double cross(const Point &o, const Point &a, const Point &b);
+  std::vector<Point> hull(std::vector<Point> points) const;
+  bool reduce(std::vector<Point> &polygon, int width, int height) const;
+public:
+  SpriteMeshGenerator(int max_vertices = 8, unsigned char alpha_threshold = 0);
+
+  // the whole quad, for images without alpha
+  static SpriteMesh quad();
+
+  // `pixels` is RGBA with the top row first, as decoded
+  SpriteMesh generate(const unsigned char* pixels, int width, int height) const;
+
+  // fragments rasterized by `draw`, counted with an occlusion query
+  template <typename Draw>
+  static unsigned int count_fragments(Draw draw);
+};
+
+SpriteMeshGenerator::SpriteMeshGenerator(int max_vertices, unsigned char alpha_threshold)
+  : max_vertices(std::max(max_vertices, 3)), alpha_threshold(alpha_threshold) {}
+
+double SpriteMeshGenerator::cross(const Point &o, const Point &a, const Point &b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+std::vector<SpriteMeshGenerator::Point> SpriteMeshGenerator::hull(std::vector<Point> points) const {
+  // Andrew's monotone chain, counter-clockwise without collinear points
+  std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+  std::vector<Point> result(points.size() * 2);
+  size_t count = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    while (count >= 2 && cross(result[count - 2], result[count - 1], points[i]) <= 0) {
+      count--;
+    }
+    result[count++] = points[i];
+  }
+  for (size_t i = points.size() - 1, lower = count + 1; i-- > 0;) {
+    while (count >= lower && cross(result[count - 2], result[count - 1], points[i]) <= 0) {
+      count--;
+    }
+    result[count++] = points[i];
+  }
+  result.resize(count > 1 ? count - 1 : count);
+  return result;
+}
+
+bool SpriteMeshGenerator::reduce(std::vector<Point> &polygon, int width, int height) const {
+  while ((int)polygon.size() > max_vertices) {
+    size_t n = polygon.size();
+    size_t best = n;
+    double best_area = INFINITY;
+    Point best_point {};
+    for (size_t i = 0; i < n; i++) {
+      // merge edge b-c: extend a-b forwards and d-c backwards until they meet at p
+      const Point& a = polygon[(i + n - 1) % n];
+      const Point& b = polygon[i];
+      const Point& c = polygon[(i + 1) % n];
+      const Point& d = polygon[(i + 2) % n];
+      Point ab {b.x - a.x, b.y - a.y};
+      Point dc {c.x - d.x, c.y - d.y};
+      double denominator = ab.x * dc.y - ab.y * dc.x;
+      if (std::fabs(denominator) < 1e-12) {
+        continue;
+      }
+      double t = ((c.x - b.x) * dc.y - (c.y - b.y) * dc.x) / denominator;
+      double s = ((c.x - b.x) * ab.y - (c.y - b.y) * ab.x) / denominator;
+      if (t < 0 || s < 0) {
+        continue; // the edges diverge, merging would cut into the sprite
+      }
+      Point p {b.x + ab.x * t, b.y + ab.y * t};
+      if (p.x < -1e-9 || p.y < -1e-9 || p.x > width + 1e-9 || p.y > height + 1e-9) {
+        continue;
+      }
+      double area = std::fabs(cross(b, p, c)) / 2.0;
+      if (area < best_area) {
+        best = i;
+        best_area = area;
+        best_point = p;
+      }
+    }
+    if (best == n) {
+      return false;
+    }
+    polygon[best] = best_point;
+    polygon.erase(polygon.begin() + (best + 1) % n);
+  }
+  return true;
+}
+
+SpriteMesh SpriteMeshGenerator::quad() {
+  return {{0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f}, {0, 1, 2, 0, 2, 3}, 1.0f};
+}
+
+SpriteMesh SpriteMeshGenerator::generate(const unsigned char* pixels, int width, int height) const {
+  // corners of the first and last visible texel of every row
+  std::vector<Point> points;
+  for (int y = 0; y < height; y++) {
+    int first = -1;
+    int last = -1;
+    for (int x = 0; x < width; x++) {
+      if (pixels[((size_t)y * width + x) * 4 + 3] > alpha_threshold) {
+        first = first == -1 ? x : first;
+        last = x;
+      }
+    }
+    if (first != -1) {
+      points.insert(points.end(), {{(double)first, (double)y}, {(double)first, y + 1.0}, {last + 1.0, (double)y}, {last + 1.0, y + 1.0}});
+    }
+  }
+
+  std::vector<Point> polygon = points.empty() ? std::vector<Point>() : hull(points);
+  if (polygon.size() < 3 || !reduce(polygon, width, height)) {
+    polygon = {{0, 0}, {0, (double)height}, {(double)width, (double)height}, {(double)width, 0}};
+  }
+
+  SpriteMesh mesh;
+  double area = 0.0;
+  for (size_t i = 0; i < polygon.size(); i++) {
+    mesh.vertices.push_back(polygon[i].x / width);
+    mesh.vertices.push_back(1.0 - polygon[i].y / height);
+    area += cross({0, 0}, polygon[i], polygon[(i + 1) % polygon.size()]);
+  }
+  for (unsigned int i = 1; i + 1 < polygon.size(); i++) {
+    mesh.indices.insert(mesh.indices.end(), {0, i, i + 1});
+  }
+  mesh.coverage = std::fabs(area) / 2.0 / ((double)width * height);
+  return mesh;
+}
+
+template <typename Draw>
+unsigned int SpriteMeshGenerator::count_fragments(Draw draw) {
+  unsigned int query;
+  unsigned int samples;
+  glGenQueries(1, &query);
+  glBeginQuery(GL_SAMPLES_PASSED, query);
+  draw();
+  glEndQuery(GL_SAMPLES_PASSED);
+  glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+  glDeleteQueries(1, &query);
+  return samples;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef STATE_CACHE_H
+#define STATE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <map>
+#include <utility>
+
+// Mirrors the texture and sampler bindings of every unit so redundant binds are skipped.
+// Anything binding textures behind its back must call invalidate().
+class StateCache {
+private:
+  unsigned int active_unit {0};
+  std::map<std::pair<unsigned int, GLenum>, unsigned int> textures;
+  std::map<unsigned int, unsigned int> samplers;
+  unsigned long skipped {0};
+
+  void activate(unsigned int unit);
+public:
+  void bind_texture(unsigned int unit, GLenum target, unsigned int texture);
+  void bind_sampler(unsigned int unit, unsigned int sampler);
+  // forgets `texture` wherever it is bound, call before deleting it
+  void forget_texture(unsigned int texture);
+  void invalidate();
+
+  unsigned long skipped_binds() const;
+};
+
+inline StateCache state_cache;
+
+void StateCache::activate(unsigned int unit) {
+  if (unit != active_unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_unit = unit;
+  }
+}
+
+void StateCache::bind_texture(unsigned int unit, GLenum target, unsigned int texture) {
+  auto key = std::make_pair(unit, target);
+  auto bound = textures.find(key);
+  if (bound != textures.end() && bound->second == texture) {
+    skipped++;
+    return;
+  }
+  activate(unit);
+  glBindTexture(target, texture);
+  textures[key] = texture;
+}
+
+void StateCache::bind_sampler(unsigned int unit, unsigned int sampler) {
+  auto bound = samplers.find(unit);
+  if (bound != samplers.end() && bound->second == sampler) {
+    skipped++;
+    return;
+  }
+  glBindSampler(unit, sampler);
+  samplers[unit] = sampler;
+}
+
+void StateCache::forget_texture(unsigned int texture) {
+  for (auto it = textures.begin(); it != textures.end();) {
+    it = it->second == texture ? textures.erase(it) : std::next(it);
+  }
+}
+
+void StateCache::invalidate() {
+  int unit;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+  active_unit = unit - GL_TEXTURE0;
+  textures.clear();
+  samplers.clear();
+}
+
+unsigned long StateCache::skipped_binds() const {
+  return skipped;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+#include <state_cache.h>
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+struct TextureLayer {
+  unsigned int texture; // GL_TEXTURE_2D_ARRAY object
+  unsigned int layer;
+};
+
+// Groups same-size, same-format textures into GL_TEXTURE_2D_ARRAY objects, so switching
+// between them is a layer index in the vertex data instead of a texture bind.
+// Arrays have a fixed number of layers; a full group starts another array.
+class TextureArrays {
+private:
+  struct Format {
+    int width;
+    int height;
+    GLenum internal_format;
+
+    auto operator<=>(const Format&) const = default;
+  };
+  struct Array {
+    unsigned int texture;
+    std::vector<unsigned int> free_layers;
+    bool dirty {false}; // layers added since the mips were last built
+  };
+  int layers_per_array;
+  std::map<Format, std::vector<Array>> arrays;
+
+  Array create(const Format &format) const;
+public:
+  TextureArrays(int layers_per_array = 64);
+
+  // uploads an image into a free layer of an array matching its size and format; its mips
+  // are built by the next generate_mips()
+  TextureLayer add(const unsigned char* pixels, int width, int height, GLenum format, GLenum internal_format);
+  // returns the layer to its array for reuse
+  void remove(TextureLayer layer);
+
+  // rebuilds the mips of arrays that got layers since the last call, once per batch of adds
+  void generate_mips();
+
+  void clear();
+};
+
+TextureArrays::TextureArrays(int layers_per_array) {
+  int max_layers;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+  this->layers_per_array = std::min(layers_per_array, max_layers);
+}
+
+TextureArrays::Array TextureArrays::create(const Format &format) const {
+  Array array;
+  glGenTextures(1, &array.texture);
+  state_cache.bind_texture(0, GL_TEXTURE_2D_ARRAY, array.texture);
+
+  int levels = (int)std::log2(std::max(format.width, format.height)) + 1;
+  for (int level = 0; level < levels; level++) {
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internal_format,
+                 std::max(format.width >> level, 1), std::max(format.height >> level, 1), layers_per_array,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  }
+
+  // hand out low layers first
+  for (int layer = layers_per_array - 1; layer >= 0; layer--) {
+    array.free_layers.push_back(layer);
+  }
+  return array;
+}
+
+TextureLayer TextureArrays::add(const unsigned char* pixels, int width, int height, GLenum format, GLenum internal_format) {
+  std::vector<Array>& group = arrays[{width, height, internal_format}];
+  auto array = std::find_if(group.begin(), group.end(), [](const Array& array) { return !array.free_layers.empty(); });
+  if (array == group.end()) {
+    group.push_back(create({width, height, internal_format}));
+    array = group.end() - 1;
+  }
+
+  unsigned int layer = array->free_layers.back();
+  array->free_layers.pop_back();
+
+  state_cache.bind_texture(0, GL_TEXTURE_2D_ARRAY, array->texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  array->dirty = true;
+  return {array->texture, layer};
+}
+
+void TextureArrays::generate_mips() {
+  // glGenerateMipmap rebuilds every layer of an array, so it runs once however many were added
+  for (auto& [format, group] : arrays) {
+    for (Array& array : group) {
+      if (array.dirty) {
+        state_cache.bind_texture(0, GL_TEXTURE_2D_ARRAY, array.texture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        array.dirty = false;
+      }
+    }
+  }
+}
+
+void TextureArrays::remove(TextureLayer layer) {
+  for (auto& [format, group] : arrays) {
+    for (Array& array : group) {
+      if (array.texture == layer.texture) {
+        array.free_layers.push_back(layer.layer);
+        return;
+      }
+    }
+  }
+}
+
+void TextureArrays::clear() {
+  for (auto& [format, group] : arrays) {
+    for (Array& array : group) {
+      state_cache.forget_texture(array.texture);
+      glDeleteTextures(1, &array.texture);
+    }
+  }
+  arrays.clear();
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glad/glad.h>
+#include <state_cache.h>
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+// Bottom-left skyline packing: the top edge of the packed area is kept as a list of
+// horizontal segments and each rectangle goes where it ends up lowest.
+class SkylinePacker {
+private:
+  struct Segment {
+    int x;
+    int y;
+    int width;
+  };
+  int width;
+  int height;
+  std::vector<Segment> skyline;
+
+  // y a rectangle of `rect_width` would rest at when placed at segment `index`, or -1
+  int fit(size_t index, int rect_width, int rect_height) const;
+public:
+  SkylinePacker(int width, int height);
+
+  bool insert(int rect_width, int rect_height, int &x, int &y);
+};
+
+struct AtlasRegion {
+  unsigned int page;
+  float u0;
+  float v0;
+  float u1;
+  float v1;
+
+  // maps a [0, 1] texture coordinate of the source image into the atlas page
+  void remap(float &u, float &v) const;
+};
+
+// Packs small RGBA images into large pages so many sprites share one texture bind.
+// Every image is surrounded by a gutter of repeated edge texels and placed on a
+// MIP_ALIGNMENT grid, so the first mip levels never blend neighbouring images.
+class TextureAtlas {
+private:
+  const int MIP_ALIGNMENT = 4;
+  struct Page {
+    SkylinePacker packer;
+    std::vector<unsigned char> pixels;
+    unsigned int texture {0};
+    bool dirty {true};
+  };
+  int page_size;
+  int padding;
+  std::vector<Page> pages;
+
+  void blit(Page &page, const unsigned char* pixels, int width, int height, int channels, int x, int y) const;
+public:
+  TextureAtlas(int page_size = 2048, int padding = 4);
+
+  // copies the image into a page; fails when it does not fit in an empty page
+  std::optional<AtlasRegion> add(const unsigned char* pixels, int width, int height, int channels);
+
+  // (re)uploads pages changed since the last call and rebuilds their mips
+  void upload();
+
+  unsigned int page_texture(unsigned int page) const;
+  size_t page_count() const;
+  void clear();
+};
+
+SkylinePacker::SkylinePacker(int width, int height) : width(width), height(height) {
+  skyline.push_back({0, 0, width});
+}
+
+int SkylinePacker::fit(size_t index, int rect_width, int rect_height) const {
+  int x = skyline[index].x;
+  if (x + rect_width > width) {
+    return -1;
+  }
+  int y = 0;
+  int remaining = rect_width;
+  for (size_t i = index; remaining > 0; i++) {
+    y = std::max(y, skyline[i].y);
+    if (y + rect_height > height) {
+      return -1;
+    }
+    remaining -= skyline[i].width;
+  }
+  return y;
+}
+
+bool SkylinePacker::insert(int rect_width, int rect_height, int &x, int &y) {
+  size_t best = skyline.size();
+  int best_y = INT_MAX;
+  int best_width = INT_MAX;
+  for (size_t i = 0; i < skyline.size(); i++) {
+    int fit_y = fit(i, rect_width, rect_height);
+    if (fit_y != -1 && (fit_y < best_y || (fit_y == best_y && skyline[i].width < best_width))) {
+      best = i;
+      best_y = fit_y;
+      best_width = skyline[i].width;
+    }
+  }
+  if (best == skyline.size()) {
+    return false;
+  }
+
+  x = skyline[best].x;
+  y = best_y;
+  skyline.insert(skyline.begin() + best, {x, y + rect_height, rect_width});
+
+  // trim the segments now covered by the new one
+  for (size_t i = best + 1; i < skyline.size();) {
+    int covered = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+    if (covered <= 0) {
+      break;
+    }
+    if (covered < skyline[i].width) {
+      skyline[i].x += covered;
+      skyline[i].width -= covered;
+      break;
+    }
+    skyline.erase(skyline.begin() + i);
+  }
+
+  // merge neighbours of equal height
+  for (size_t i = 0; i + 1 < skyline.size();) {
+    if (skyline[i].y == skyline[i + 1].y) {
+      skyline[i].width += skyline[i + 1].width;
+      skyline.erase(skyline.begin() + i + 1);
+    }
+    else {
+      i++;
+    }
+  }
+  return true;
+}
+
+void AtlasRegion::remap(float &u, float &v) const {
+  u = u0 + u * (u1 - u0);
+  v = v0 + v * (v1 - v0);
+}
+
+TextureAtlas::TextureAtlas(int page_size, int padding) : page_size(page_size), padding(padding) {}
+
+void TextureAtlas::blit(Page &page, const unsigned char* pixels, int width, int height, int channels, int x, int y) const {
+  // the gutter repeats the nearest edge texel, clamping the source coordinate
+  for (int row = -padding; row < height + padding; row++) {
+    int source_row = std::clamp(row, 0, height - 1);
+    unsigned char* destination = &page.pixels[((size_t)(y + row) * page_size + x - padding) * 4];
+    for (int column = -padding; column < width + padding; column++) {
+      int source_column = std::clamp(column, 0, width - 1);
+      const unsigned char* source = &pixels[((size_t)source_row * width + source_column) * channels];
+      switch (channels) {
+      case 1:
+        destination[0] = destination[1] = destination[2] = source[0];
+        destination[3] = 255;
+        break;
+      case 2:
+        destination[0] = destination[1] = destination[2] = source[0];
+        destination[3] = source[1];
+        break;
+      case 3:
+        destination[0] = source[0];
+        destination[1] = source[1];
+        destination[2] = source[2];
+        destination[3] = 255;
+        break;
+      default:
+        std::copy(source, source + 4, destination);
+      }
+      destination += 4;
+    }
+  }
+  page.dirty = true;
+}
+
+std::optional<AtlasRegion> TextureAtlas::add(const unsigned char* pixels, int width, int height, int channels) {
+  auto align = [&](int size) { return (size + 2 * padding + MIP_ALIGNMENT - 1) / MIP_ALIGNMENT * MIP_ALIGNMENT; };
+  int rect_width = align(width);
+  int rect_height = align(height);
+  if (rect_width > page_size || rect_height > page_size) {
+    std::cout << "ERROR::TEXTURE_ATLAS::IMAGE_TOO_LARGE " << width << "x" << height << std::endl;
+    return std::nullopt;
+  }
+
+  int x;
+  int y;
+  size_t index = 0;
+  while (index < pages.size() && !pages[index].packer.insert(rect_width, rect_height, x, y)) {
+    index++;
+  }
+  if (index == pages.size()) {
+    pages.push_back({SkylinePacker(page_size, page_size), std::vector<unsigned char>((size_t)page_size * page_size * 4)});
+    pages.back().packer.insert(rect_width, rect_height, x, y);
+  }
+
+  x += padding;
+  y += padding;
+  blit(pages[index], pixels, width, height, channels, x, y);
+
+  float scale = 1.0f / page_size;
+  return AtlasRegion {(unsigned int)index, x * scale, y * scale, (x + width) * scale, (y + height) * scale};
+}
+
+void TextureAtlas::upload() {
+  for (Page& page : pages) {
+    if (!page.dirty) {
+      continue;
+    }
+    if (!page.texture) {
+      glGenTextures(1, &page.texture);
+    }
+    state_cache.bind_texture(0, GL_TEXTURE_2D, page.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, page_size, page_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, page.pixels.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    page.dirty = false;
+  }
+}
+
+unsigned int TextureAtlas::page_texture(unsigned int page) const {
+  return pages[page].texture;
+}
+
+size_t TextureAtlas::page_count() const {
+  return pages.size();
+}
+
+void TextureAtlas::clear() {
+  for (Page& page : pages) {
+    state_cache.forget_texture(page.texture);
+    glDeleteTextures(1, &page.texture);
+  }
+  pages.clear();
+}
+
+#endif
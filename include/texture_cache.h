@@ -0,0 +1,124 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <assets.h>
+#include <content_hash.h>
+#include <state_cache.h>
+
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+
+// Textures keyed by a hash of their file bytes, so an image loaded twice, or under
+// several names, is decoded and uploaded once and every user shares the same GL
+// texture. Equal hashes are confirmed by comparing the bytes, so a collision can never
+// alias two different images. The texture is deleted when its last user releases it.
+class TextureCache {
+private:
+  struct Entry {
+    Asset source;          // asset bytes live as long as `assets`, or point into `reloaded`
+    unsigned int texture;
+    size_t bytes;          // decoded size, what every duplicate would have cost again
+    int references;
+    std::vector<unsigned char> reloaded {}; // file bytes once the texture was hot reloaded
+  };
+  std::unordered_multimap<uint64_t, Entry> entries;
+  size_t deduplicated {0};
+public:
+  TextureCache() = default;
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+  ~TextureCache();
+
+  // `load(texture)` decodes `source` into a fresh texture and returns the decoded size,
+  // or 0 on failure, in which case 0 is returned and nothing is cached
+  template <typename Load>
+  unsigned int acquire(const Asset &source, Load load);
+  void release(unsigned int texture);
+  void clear();
+
+  // `texture` now holds `source`, decoded to `bytes`; it is keyed by the new contents, so
+  // acquiring the edited file shares it and acquiring the old one decodes afresh
+  void refresh(unsigned int texture, std::vector<unsigned char> source, size_t bytes);
+
+  // bytes not decoded and uploaded again thanks to sharing
+  size_t deduplicated_bytes() const;
+  size_t size() const;
+};
+
+TextureCache::~TextureCache() {
+  clear();
+}
+
+template <typename Load>
+unsigned int TextureCache::acquire(const Asset &source, Load load) {
+  uint64_t hash = content_hash(source.data, source.size);
+  auto [first, last] = entries.equal_range(hash);
+  for (auto it = first; it != last; it++) {
+    Entry& entry = it->second;
+    if (entry.source.size == source.size && std::memcmp(entry.source.data, source.data, source.size) == 0) {
+      entry.references++;
+      deduplicated += entry.bytes;
+      return entry.texture;
+    }
+  }
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  size_t bytes = load(texture);
+  if (bytes == 0) {
+    state_cache.forget_texture(texture);
+    glDeleteTextures(1, &texture);
+    return 0;
+  }
+  entries.emplace(hash, Entry {source, texture, bytes, 1});
+  return texture;
+}
+
+void TextureCache::release(unsigned int texture) {
+  for (auto it = entries.begin(); it != entries.end(); it++) {
+    if (it->second.texture == texture) {
+      if (--it->second.references == 0) {
+        state_cache.forget_texture(texture);
+        glDeleteTextures(1, &texture);
+        entries.erase(it);
+      }
+      return;
+    }
+  }
+}
+
+void TextureCache::refresh(unsigned int texture, std::vector<unsigned char> source, size_t bytes) {
+  for (auto it = entries.begin(); it != entries.end(); it++) {
+    if (it->second.texture == texture) {
+      // the node keeps its address, so `source` stays valid across the rehash
+      auto node = entries.extract(it);
+      Entry& entry = node.mapped();
+      entry.reloaded = std::move(source);
+      entry.source = Asset {entry.reloaded.data(), entry.reloaded.size()};
+      entry.bytes = bytes;
+      node.key() = content_hash(entry.source.data, entry.source.size);
+      entries.insert(std::move(node));
+      return;
+    }
+  }
+}
+
+void TextureCache::clear() {
+  for (auto& [hash, entry] : entries) {
+    state_cache.forget_texture(entry.texture);
+    glDeleteTextures(1, &entry.texture);
+  }
+  entries.clear();
+}
+
+size_t TextureCache::deduplicated_bytes() const {
+  return deduplicated;
+}
+
+size_t TextureCache::size() const {
+  return entries.size();
+}
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct TextureFormatOptions {
+  bool srgb {false};        // color data authored in sRGB
+  bool premultiply {false}; // premultiply color by alpha
+  bool flip {false};        // flip rows so the first one is the bottom of the image
+  int max_error {0};        // per-channel error tolerated to fit RGB5 / RGBA4
+};
+
+struct TextureUpload {
+  GLenum internal_format;
+  GLenum format;
+  GLenum type;
+  int width;
+  int height;
+  bool swizzled {false};
+  int swizzle[4] {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  std::vector<unsigned char> data {}; // level 0, tightly packed
+};
+
+// Picks the smallest internal format that holds a decoded image correctly and converts
+// the pixels to it: single-channel and gray+alpha images become R8/RG8 with a swizzle,
+// images exactly representable in 16 bits become RGB5/RGBA4, HDR images RGB9_E5.
+class TextureFormatSelector {
+private:
+  struct Analysis {
+    bool gray {true};
+    bool opaque {true};
+    int error_rgb5 {0};
+    int error_4444 {0};
+  };
+  size_t saved {0};
+
+  Analysis analyze(const unsigned char* pixels, size_t count, int channels) const;
+  void flip_vertically(unsigned char* pixels, int width, int height, size_t pixel_size) const;
+  void premultiply(unsigned char* pixels, size_t count) const;
+  unsigned int pack_rgb9_e5(float red, float green, float blue) const;
+public:
+  // `pixels` holds 8-bit images with 1 to 4 channels, as returned by stbi_load
+  TextureUpload select(const unsigned char* pixels, int width, int height, int channels, TextureFormatOptions options = {});
+  // `pixels` holds float images with 3 or 4 channels, as returned by stbi_loadf; alpha is dropped
+  TextureUpload select_hdr(const float* pixels, int width, int height, int channels, TextureFormatOptions options = {});
+
+  // uploads level 0 of the texture bound to `target`
+  void upload(GLenum target, const TextureUpload &upload) const;
+
+  // VRAM saved at level 0 by every selection so far, compared to RGBA8
+  size_t bytes_saved() const;
+};
+
+TextureFormatSelector::Analysis TextureFormatSelector::analyze(const unsigned char* pixels, size_t count, int channels) const {
+  Analysis analysis;
+  analysis.gray = channels < 3;
+  analysis.opaque = channels != 2 && channels != 4;
+  if (channels < 3) {
+    return analysis;
+  }
+
+  // error of truncating a channel to `bits` and expanding it back by bit replication
+  auto error = [](int value, int bits) {
+    int truncated = value >> (8 - bits);
+    int expanded = (truncated << (8 - bits)) | (truncated >> (2 * bits - 8));
+    return std::abs(value - expanded);
+  };
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char* pixel = &pixels[i * channels];
+    analysis.gray = analysis.gray && pixel[0] == pixel[1] && pixel[1] == pixel[2];
+    analysis.error_rgb5 = std::max({analysis.error_rgb5, error(pixel[0], 5), error(pixel[1], 5), error(pixel[2], 5)});
+    analysis.error_4444 = std::max({analysis.error_4444, error(pixel[0], 4), error(pixel[1], 4), error(pixel[2], 4)});
+    if (channels == 4) {
+      analysis.opaque = analysis.opaque && pixel[3] == 255;
+      analysis.error_4444 = std::max(analysis.error_4444, error(pixel[3], 4));
+    }
+  }
+  return analysis;
+}
+
+void TextureFormatSelector::flip_vertically(unsigned char* pixels, int width, int height, size_t pixel_size) const {
+  size_t row_size = width * pixel_size;
+  std::vector<unsigned char> row(row_size);
+  for (int top = 0, bottom = height - 1; top < bottom; top++, bottom--) {
+    std::memcpy(row.data(), &pixels[top * row_size], row_size);
+    std::memcpy(&pixels[top * row_size], &pixels[bottom * row_size], row_size);
+    std::memcpy(&pixels[bottom * row_size], row.data(), row_size);
+  }
+}
+
+void TextureFormatSelector::premultiply(unsigned char* pixels, size_t count) const {
+  // value * alpha / 255, rounded: t = value * alpha + 128, (t + (t >> 8)) >> 8
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  const __m128i opaque = _mm_set1_epi16(255);
+  for (; i + 4 <= count; i += 4) {
+    __m128i packed = _mm_loadu_si128((const __m128i*)&pixels[i * 4]);
+    __m128i halves[2] {_mm_unpacklo_epi8(packed, zero), _mm_unpackhi_epi8(packed, zero)};
+    for (__m128i& value : halves) {
+      __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(value, 0xFF), 0xFF);
+      // alpha itself is multiplied by 255 so it stays unchanged
+      alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha), _mm_and_si128(alpha_lanes, opaque));
+      __m128i product = _mm_add_epi16(_mm_mullo_epi16(value, alpha), half);
+      value = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+    }
+    _mm_storeu_si128((__m128i*)&pixels[i * 4], _mm_packus_epi16(halves[0], halves[1]));
+  }
+#endif
+  for (; i < count; i++) {
+    unsigned char* pixel = &pixels[i * 4];
+    for (int channel = 0; channel < 3; channel++) {
+      unsigned int product = pixel[channel] * pixel[3] + 128;
+      pixel[channel] = (product + (product >> 8)) >> 8;
+    }
+  }
+}
+
+unsigned int TextureFormatSelector::pack_rgb9_e5(float red, float green, float blue) const {
+  // EXT_texture_shared_exponent: 9-bit mantissas, 5-bit exponent with a bias of 15
+  const float max_value = 511.0f / 512.0f * 65536.0f;
+  red = std::clamp(red, 0.0f, max_value);
+  green = std::clamp(green, 0.0f, max_value);
+  blue = std::clamp(blue, 0.0f, max_value);
+  float largest = std::max({red, green, blue});
+  if (largest == 0.0f) {
+    return 0;
+  }
+
+  int exponent = std::max(-16, (int)std::floor(std::log2(largest))) + 16;
+  float denominator = std::exp2(exponent - 24.0f);
+  if ((int)std::floor(largest / denominator + 0.5f) == 512) {
+    denominator *= 2.0f;
+    exponent++;
+  }
+  unsigned int r = std::floor(red / denominator + 0.5f);
+  unsigned int g = std::floor(green / denominator + 0.5f);
+  unsigned int b = std::floor(blue / denominator + 0.5f);
+  return r | (g << 9) | (b << 18) | ((unsigned int)exponent << 27);
+}
+
+TextureUpload TextureFormatSelector::select(const unsigned char* pixels, int width, int height, int channels, TextureFormatOptions options) {
+  size_t count = (size_t)width * height;
+  Analysis analysis = analyze(pixels, count, channels);
+
+  // expand to RGBA once; every conversion below reads from it
+  std::vector<unsigned char> rgba(count * 4);
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char* source = &pixels[i * channels];
+    unsigned char* destination = &rgba[i * 4];
+    destination[0] = source[0];
+    destination[1] = channels >= 3 ? source[1] : source[0];
+    destination[2] = channels >= 3 ? source[2] : source[0];
+    destination[3] = channels == 4 ? source[3] : channels == 2 ? source[1] : 255;
+  }
+  if (options.flip) {
+    flip_vertically(rgba.data(), width, height, 4);
+  }
+  if (options.premultiply && !analysis.opaque) {
+    premultiply(rgba.data(), count);
+  }
+
+  TextureUpload upload {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height};
+  // gray images keep one channel, so their values have no sRGB counterpart in core 3.3
+  if (analysis.gray && !options.srgb) {
+    upload.swizzled = true;
+    upload.internal_format = analysis.opaque ? GL_R8 : GL_RG8;
+    upload.format = analysis.opaque ? GL_RED : GL_RG;
+    int swizzle[4] {GL_RED, GL_RED, GL_RED, analysis.opaque ? GL_ONE : GL_GREEN};
+    std::copy(swizzle, swizzle + 4, upload.swizzle);
+    size_t kept = analysis.opaque ? 1 : 2;
+    upload.data.resize(count * kept);
+    for (size_t i = 0; i < count; i++) {
+      upload.data[i * kept] = rgba[i * 4];
+      if (kept == 2) {
+        upload.data[i * kept + 1] = rgba[i * 4 + 3];
+      }
+    }
+  }
+  else if (options.srgb) {
+    upload.internal_format = analysis.opaque ? GL_SRGB8 : GL_SRGB8_ALPHA8;
+    upload.data = std::move(rgba);
+  }
+  else if (analysis.opaque && analysis.error_rgb5 <= options.max_error) {
+    // GL_RGB565 needs 4.1; the 3.3 GL_RGB5 may be stored with a 5-bit green
+    upload.internal_format = GL_RGB5;
+    upload.format = GL_RGB;
+    upload.type = GL_UNSIGNED_SHORT_5_6_5;
+    upload.data.resize(count * 2);
+    for (size_t i = 0; i < count; i++) {
+      const unsigned char* pixel = &rgba[i * 4];
+      unsigned short texel = ((pixel[0] >> 3) << 11) | ((pixel[1] >> 2) << 5) | (pixel[2] >> 3);
+      std::memcpy(&upload.data[i * 2], &texel, 2);
+    }
+  }
+  else if (!analysis.opaque && analysis.error_4444 <= options.max_error && !options.premultiply) {
+    upload.internal_format = GL_RGBA4;
+    upload.type = GL_UNSIGNED_SHORT_4_4_4_4;
+    upload.data.resize(count * 2);
+    for (size_t i = 0; i < count; i++) {
+      const unsigned char* pixel = &rgba[i * 4];
+      unsigned short texel = ((pixel[0] >> 4) << 12) | ((pixel[1] >> 4) << 8) | ((pixel[2] >> 4) << 4) | (pixel[3] >> 4);
+      std::memcpy(&upload.data[i * 2], &texel, 2);
+    }
+  }
+  else if (analysis.opaque) {
+    upload.internal_format = GL_RGB8;
+    upload.format = GL_RGB;
+    upload.data.resize(count * 3);
+    for (size_t i = 0; i < count; i++) {
+      std::memcpy(&upload.data[i * 3], &rgba[i * 4], 3);
+    }
+  }
+  else {
+    upload.data = std::move(rgba);
+  }
+
+  saved += count * 4 - upload.data.size();
+  return upload;
+}
+
+TextureUpload TextureFormatSelector::select_hdr(const float* pixels, int width, int height, int channels, TextureFormatOptions options) {
+  size_t count = (size_t)width * height;
+  TextureUpload upload {GL_RGB9_E5, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, width, height};
+  upload.data.resize(count * 4);
+  for (size_t i = 0; i < count; i++) {
+    const float* pixel = &pixels[i * channels];
+    unsigned int texel = pack_rgb9_e5(pixel[0], pixel[1], pixel[2]);
+    std::memcpy(&upload.data[i * 4], &texel, 4);
+  }
+  if (options.flip) {
+    flip_vertically(upload.data.data(), width, height, 4);
+  }
+
+  // compared to the RGBA16F an HDR image would otherwise take
+  saved += count * 8 - upload.data.size();
+  return upload;
+}
+
+void TextureFormatSelector::upload(GLenum target, const TextureUpload &upload) const {
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(target, 0, upload.internal_format, upload.width, upload.height, 0, upload.format, upload.type, upload.data.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  if (upload.swizzled) {
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, upload.swizzle);
+  }
+}
+
+size_t TextureFormatSelector::bytes_saved() const {
+  return saved;
+}
+
+#endif
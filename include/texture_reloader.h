@@ -0,0 +1,182 @@
+#ifndef TEXTURE_RELOADER_H
+#define TEXTURE_RELOADER_H
+
+#include <texture_format.h>
+#include <texture_streaming.h>
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+
+// Watches the files textures were loaded from and re-decodes them, mip chain included,
+// on a worker thread when they change. Finished reloads wait until update() hands them to the GL thread
+// between frames, which re-specifies the same texture object, so handles and bindings
+// stay valid and rendering never waits for a decode. Directories are watched rather
+// than files so editors that save through a temporary file and a rename are seen too.
+// A texture shared by several identical files changes for all of them.
+class TextureReloader {
+public:
+  struct Reload {
+    unsigned int texture {0};
+    std::string path {};
+    std::vector<unsigned char> bytes {};        // the file as read
+    size_t decoded {0};                         // decoded image size
+    TextureUpload upload {};                    // format, level 0 moved into `mips`
+    std::vector<TextureStreaming::Mip> mips {}; // full chain
+  };
+  // runs on the worker thread with `bytes` and `path` set, fills in the rest; false when
+  // the bytes do not decode
+  using Decode = std::function<bool(Reload &reload)>;
+private:
+  Decode decode;
+  int inotify {-1};
+  int wake {-1}; // eventfd that stops the worker
+  std::mutex mutex;
+  std::map<int, std::string> directories;           // watch descriptor -> directory
+  std::multimap<std::string, unsigned int> watched; // file path -> textures
+  std::vector<Reload> finished;
+  std::thread worker;
+
+  void run();
+  void reload(const std::string &path);
+public:
+  TextureReloader(Decode decode);
+  TextureReloader(const TextureReloader&) = delete;
+  TextureReloader& operator=(const TextureReloader&) = delete;
+  ~TextureReloader();
+
+  // false when the file cannot be watched
+  bool watch(unsigned int texture, const std::string &path);
+
+  // calls `apply(reload)` for every finished reload, on the GL thread between frames;
+  // returns how many were applied
+  template <typename Apply>
+  int update(Apply apply);
+};
+
+TextureReloader::TextureReloader(Decode decode) : decode(std::move(decode)) {
+  inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (inotify == -1 || wake == -1) {
+    std::cout << "ERROR::TEXTURE_RELOADER::NO_FILE_WATCHING" << std::endl;
+    return;
+  }
+  worker = std::thread(&TextureReloader::run, this);
+}
+
+TextureReloader::~TextureReloader() {
+  if (worker.joinable()) {
+    uint64_t stop = 1;
+    (void)!write(wake, &stop, sizeof(stop));
+    worker.join();
+  }
+  if (inotify != -1) {
+    close(inotify);
+  }
+  if (wake != -1) {
+    close(wake);
+  }
+}
+
+bool TextureReloader::watch(unsigned int texture, const std::string &path) {
+  if (!worker.joinable()) {
+    return false;
+  }
+  size_t slash = path.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+  std::string file = slash == std::string::npos ? "./" + path : path;
+
+  // watching a directory twice returns its existing descriptor
+  int descriptor = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (descriptor == -1) {
+    std::cout << "ERROR::TEXTURE_RELOADER::WATCH_FAILED " << directory << std::endl;
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  directories[descriptor] = directory;
+  watched.emplace(file, texture);
+  return true;
+}
+
+void TextureReloader::run() {
+  alignas(inotify_event) char buffer[4096];
+  pollfd descriptors[2] {{inotify, POLLIN, 0}, {wake, POLLIN, 0}};
+  while (true) {
+    if (poll(descriptors, 2, -1) == -1) {
+      continue;
+    }
+    if (descriptors[1].revents & POLLIN) {
+      return;
+    }
+
+    // a save usually shows up as several events, each file is decoded once per batch
+    std::set<std::string> changed;
+    ssize_t length;
+    while ((length = read(inotify, buffer, sizeof(buffer))) > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (char* event = buffer; event < buffer + length; event += sizeof(inotify_event) + ((inotify_event*)event)->len) {
+        const inotify_event* notification = (const inotify_event*)event;
+        auto directory = directories.find(notification->wd);
+        if (notification->len == 0 || directory == directories.end()) {
+          continue;
+        }
+        std::string path = directory->second + "/" + notification->name;
+        if (watched.count(path)) {
+          changed.insert(path);
+        }
+      }
+    }
+    for (const std::string& path : changed) {
+      reload(path);
+    }
+  }
+}
+
+void TextureReloader::reload(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  Reload decoded;
+  decoded.path = path;
+  decoded.bytes.assign(std::istreambuf_iterator<char>(file), {});
+  if (decoded.bytes.empty() || !decode(decoded)) {
+    // keep the current contents, a later save will try again
+    std::cout << "ERROR::TEXTURE_RELOADER::DECODE_FAILED " << path << std::endl;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto [first, last] = watched.equal_range(path);
+  for (auto it = first; it != last; it++) {
+    // a newer decode of the same texture replaces one not applied yet
+    std::erase_if(finished, [&](const Reload& reload) { return reload.texture == it->second; });
+    finished.push_back(decoded);
+    finished.back().texture = it->second;
+  }
+}
+
+template <typename Apply>
+int TextureReloader::update(Apply apply) {
+  std::vector<Reload> ready;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.swap(finished);
+  }
+  for (Reload& reload : ready) {
+    apply(reload);
+  }
+  return ready.size();
+}
+
+#endif
@@ -0,0 +1,453 @@
+#ifndef TEXTURE_STREAMING_H
+#define TEXTURE_STREAMING_H
+
+#include <glad/glad.h>
+#include <state_cache.h>
+#include <texture_format.h>
+#include <upload_scheduler.h>
+#include <job_pool.h>
+
+#include <map>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+// Keeps the mip chain of each texture in memory but only the levels the screen needs on
+// the GPU. A texture's small initial levels are queued together when it is added; finer
+// levels then stream in one per texture at a time as draws request them, and under the
+// VRAM budget the finest levels of textures needing less are dropped first. Levels go up
+// through an UploadScheduler in bands, straight from the chain kept here, and
+// GL_TEXTURE_BASE_LEVEL moves to a level once all of it is up, so handles stay valid
+// and sampling only ever sees complete levels. Past the memory budget, the in-memory
+// copies of fine levels are dropped from the least recently requested textures that
+// have a source to rebuild their chain from; a dropped level is rebuilt on the job pool
+// when a draw asks for it again.
+class TextureStreaming {
+public:
+  struct Mip {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels {};
+  };
+  // rebuilds the full chain, as build_mips() does, on a job pool worker; false when the
+  // texture's source is gone
+  using Source = std::function<bool(std::vector<Mip> &mips)>;
+private:
+  // frames a texture may go unrequested before it only needs its initial levels
+  const unsigned long IDLE_FRAMES = 120;
+  // how the channels of a texel are stored: a byte each, or bit fields of one 16-bit word
+  struct TexelLayout {
+    int size; // bytes per texel
+    int channels;
+    bool packed;
+    int bits[4];
+    int shifts[4];
+
+    int read(const unsigned char* texel, int channel) const;
+    void write(unsigned char* texel, int channel, int value) const;
+  };
+  struct StreamedTexture {
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    TexelLayout layout;
+    std::vector<Mip> mips {}; // levels dropped from memory keep their size, with no pixels
+    Source source {};         // without one every level stays in memory
+    std::future<std::vector<Mip>> rebuild {};
+    int initial_level {0};  // finest level of the initial upload
+    int resident_level {0}; // finest level on the GPU
+    int queued_level {0};   // finest level on the GPU or queued, below resident_level while uploading
+    int wanted_level {0};
+    unsigned long last_request {0};
+  };
+  UploadScheduler& uploads;
+  size_t budget;
+  size_t memory_budget;
+  int initial_size;
+  size_t resident {0};
+  size_t memory {0}; // pixels held in the chains
+  size_t rebuilds {0};
+  unsigned long frame {0};
+  std::map<unsigned int, StreamedTexture> textures;
+
+  static std::optional<TexelLayout> texel_layout(const TextureUpload &upload);
+  static void downsample(const TexelLayout &layout, std::vector<Mip> &mips);
+  size_t level_bytes(const StreamedTexture &streamed, int level) const;
+  void upload_level(unsigned int texture, StreamedTexture &streamed, int level);
+  void evict_level(unsigned int texture, StreamedTexture &streamed);
+  void release(unsigned int texture, StreamedTexture &streamed);
+  bool make_room(size_t bytes, unsigned int for_texture);
+  // drops level pixels until the chains fit the memory budget
+  void trim_memory();
+  // takes back the levels a finished rebuild restored, those `streamed` still wants
+  void finish_rebuild(StreamedTexture &streamed);
+public:
+  // `budget_bytes` bounds the levels on the GPU and `memory_budget_bytes` the levels kept in
+  // memory to upload from; `initial_size` is the largest dimension uploaded before any draw
+  // requests more; `uploads` is drained by the caller and must outlive the streamer
+  TextureStreaming(UploadScheduler &uploads, size_t budget_bytes, size_t memory_budget_bytes, int initial_size = 64);
+  TextureStreaming(const TextureStreaming&) = delete;
+  TextureStreaming& operator=(const TextureStreaming&) = delete;
+  ~TextureStreaming();
+
+  // the full mip chain of `upload`, level 0 moved out of `upload.data`; touches no GL
+  // state, so the chain can be built on the thread that decoded the image. False for
+  // formats add() does not take.
+  static bool build_mips(TextureUpload &upload, std::vector<Mip> &mips);
+
+  // takes over `texture` with the level 0 data in `upload`, in 8 bits per channel or packed
+  // 16-bit (RGB5, RGBA4) formats. Adding a texture again replaces its contents in place,
+  // e.g. after a hot reload; it samples as empty until its initial levels are up. With a
+  // `source` its fine levels may leave memory and are rebuilt from it when needed again.
+  bool add(unsigned int texture, const TextureUpload &upload, Source source = {});
+  // same with a chain from build_mips(), `upload` only gives the format
+  bool add(unsigned int texture, const TextureUpload &upload, std::vector<Mip> mips, Source source = {});
+
+  // called per draw with the on-screen size in pixels covered by the whole texture
+  void request(unsigned int texture, float screen_width, float screen_height);
+
+  // queues finer levels and evicts, call once per frame before draining the scheduler
+  void update();
+
+  // levels on the GPU and queued for it
+  size_t resident_bytes() const;
+  // level pixels held in memory
+  size_t memory_bytes() const;
+  // chains rebuilt from their source for levels dropped from memory
+  size_t rebuilt_chains() const;
+};
+
+TextureStreaming::TextureStreaming(UploadScheduler &uploads, size_t budget_bytes, size_t memory_budget_bytes, int initial_size)
+  : uploads(uploads), budget(budget_bytes), memory_budget(memory_budget_bytes), initial_size(initial_size) {}
+
+TextureStreaming::~TextureStreaming() {
+  // queued levels point into the chains about to go
+  for (auto& [texture, streamed] : textures) {
+    uploads.cancel(texture);
+  }
+}
+
+int TextureStreaming::TexelLayout::read(const unsigned char* texel, int channel) const {
+  if (!packed) {
+    return texel[channel];
+  }
+  unsigned short word;
+  std::memcpy(&word, texel, 2);
+  return (word >> shifts[channel]) & ((1 << bits[channel]) - 1);
+}
+
+void TextureStreaming::TexelLayout::write(unsigned char* texel, int channel, int value) const {
+  if (!packed) {
+    texel[channel] = value;
+    return;
+  }
+  // fields are or-ed into the word, which starts zeroed
+  unsigned short word;
+  std::memcpy(&word, texel, 2);
+  word |= value << shifts[channel];
+  std::memcpy(texel, &word, 2);
+}
+
+std::optional<TextureStreaming::TexelLayout> TextureStreaming::texel_layout(const TextureUpload &upload) {
+  // 16-bit words are stored in host order, as TextureFormatSelector packs them
+  if (upload.type == GL_UNSIGNED_SHORT_5_6_5) {
+    return TexelLayout {2, 3, true, {5, 6, 5, 0}, {11, 5, 0, 0}};
+  }
+  if (upload.type == GL_UNSIGNED_SHORT_4_4_4_4) {
+    return TexelLayout {2, 4, true, {4, 4, 4, 4}, {12, 8, 4, 0}};
+  }
+  if (upload.type != GL_UNSIGNED_BYTE) {
+    return std::nullopt;
+  }
+  int channels = upload.format == GL_RED ? 1 : upload.format == GL_RG ? 2 : upload.format == GL_RGB ? 3 : 4;
+  return TexelLayout {channels, channels, false, {8, 8, 8, 8}, {0, 0, 0, 0}};
+}
+
+void TextureStreaming::downsample(const TexelLayout &layout, std::vector<Mip> &mips) {
+  // 2x2 box filter per channel, the last row or column is repeated for odd sizes
+  while (mips.back().width > 1 || mips.back().height > 1) {
+    const Mip& source = mips.back();
+    Mip mip {std::max(source.width / 2, 1), std::max(source.height / 2, 1)};
+    mip.pixels.resize((size_t)mip.width * mip.height * layout.size);
+    for (int y = 0; y < mip.height; y++) {
+      int y0 = std::min(y * 2, source.height - 1);
+      int y1 = std::min(y * 2 + 1, source.height - 1);
+      for (int x = 0; x < mip.width; x++) {
+        int x0 = std::min(x * 2, source.width - 1);
+        int x1 = std::min(x * 2 + 1, source.width - 1);
+        unsigned char* destination = &mip.pixels[((size_t)y * mip.width + x) * layout.size];
+        for (int channel = 0; channel < layout.channels; channel++) {
+          auto texel = [&](int sx, int sy) { return layout.read(&source.pixels[((size_t)sy * source.width + sx) * layout.size], channel); };
+          int sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1);
+          layout.write(destination, channel, (sum + 2) / 4);
+        }
+      }
+    }
+    mips.push_back(std::move(mip));
+  }
+}
+
+size_t TextureStreaming::level_bytes(const StreamedTexture &streamed, int level) const {
+  // from the size, the pixels may have been dropped
+  const Mip& mip = streamed.mips[level];
+  return (size_t)mip.width * mip.height * streamed.layout.size;
+}
+
+void TextureStreaming::upload_level(unsigned int texture, StreamedTexture &streamed, int level) {
+  // counted as resident from now on, sampled once its last band is up
+  const Mip& mip = streamed.mips[level];
+  TextureUpload image {streamed.internal_format, streamed.format, streamed.type, mip.width, mip.height};
+  streamed.queued_level = level;
+  resident += level_bytes(streamed, level);
+  uploads.queue_texture_level(texture, level, image, mip.pixels, [this, texture, level]() {
+    auto found = textures.find(texture);
+    if (found == textures.end()) {
+      return;
+    }
+    state_cache.bind_texture(0, GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    found->second.resident_level = level;
+  });
+}
+
+void TextureStreaming::evict_level(unsigned int texture, StreamedTexture &streamed) {
+  int level = streamed.resident_level;
+  state_cache.bind_texture(0, GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+  // redefining the level as empty releases its storage; it lies below the base level
+  glTexImage2D(GL_TEXTURE_2D, level, streamed.internal_format, 0, 0, 0, streamed.format, streamed.type, NULL);
+  streamed.resident_level = level + 1;
+  streamed.queued_level = level + 1;
+  resident -= level_bytes(streamed, level);
+}
+
+void TextureStreaming::release(unsigned int texture, StreamedTexture &streamed) {
+  uploads.cancel(texture);
+  state_cache.bind_texture(0, GL_TEXTURE_2D, texture);
+  for (int level = streamed.queued_level; level < (int)streamed.mips.size(); level++) {
+    glTexImage2D(GL_TEXTURE_2D, level, streamed.internal_format, 0, 0, 0, streamed.format, streamed.type, NULL);
+    resident -= level_bytes(streamed, level);
+  }
+  for (const Mip& mip : streamed.mips) {
+    memory -= mip.pixels.size();
+  }
+}
+
+bool TextureStreaming::make_room(size_t bytes, unsigned int for_texture) {
+  while (resident + bytes > budget) {
+    // drop the finest level of whichever texture holds the most more than it needs
+    auto victim = textures.end();
+    int victim_excess = 0;
+    for (auto it = textures.begin(); it != textures.end(); it++) {
+      // a texture mid-upload keeps its levels, the one arriving would sit on an evicted one
+      int excess = it->second.wanted_level - it->second.resident_level;
+      bool uploading = it->second.queued_level < it->second.resident_level;
+      if (it->first != for_texture && !uploading && excess > victim_excess) {
+        victim = it;
+        victim_excess = excess;
+      }
+    }
+    if (victim == textures.end()) {
+      return false;
+    }
+    evict_level(victim->first, victim->second);
+  }
+  return true;
+}
+
+void TextureStreaming::trim_memory() {
+  while (memory > memory_budget) {
+    // the finest level in memory of the least recently requested texture that can rebuild it;
+    // initial levels stay, and so do wanted levels not on the GPU yet, the one uploading included
+    StreamedTexture* victim = nullptr;
+    int victim_level = 0;
+    for (auto& [texture, streamed] : textures) {
+      if (!streamed.source || (victim && streamed.last_request >= victim->last_request)) {
+        continue;
+      }
+      for (int level = 0; level < streamed.initial_level; level++) {
+        bool needed = level >= std::min(streamed.wanted_level, streamed.queued_level) && level < streamed.resident_level;
+        if (!streamed.mips[level].pixels.empty() && !needed) {
+          victim = &streamed;
+          victim_level = level;
+          break;
+        }
+      }
+    }
+    if (!victim) {
+      return;
+    }
+    std::vector<unsigned char>& pixels = victim->mips[victim_level].pixels;
+    memory -= pixels.size();
+    pixels = {};
+  }
+}
+
+void TextureStreaming::finish_rebuild(StreamedTexture &streamed) {
+  std::vector<Mip> rebuilt = streamed.rebuild.get();
+  if (rebuilt.size() != streamed.mips.size()) {
+    return; // the source failed, or changed size since; the texture stays at the levels it has
+  }
+  // only the wanted levels not on the GPU yet, the others would be dropped again
+  for (int level = streamed.wanted_level; level < std::min(streamed.initial_level, streamed.resident_level); level++) {
+    Mip& mip = streamed.mips[level];
+    if (mip.pixels.empty() && rebuilt[level].width == mip.width && rebuilt[level].height == mip.height) {
+      mip.pixels = std::move(rebuilt[level].pixels);
+      memory += mip.pixels.size();
+    }
+  }
+  rebuilds++;
+}
+
+bool TextureStreaming::build_mips(TextureUpload &upload, std::vector<Mip> &mips) {
+  std::optional<TexelLayout> layout = texel_layout(upload);
+  if (!layout) {
+    std::cout << "ERROR::TEXTURE_STREAMING::UNSUPPORTED_FORMAT " << upload.internal_format << std::endl;
+    return false;
+  }
+  mips.clear();
+  mips.push_back({upload.width, upload.height, std::move(upload.data)});
+  upload.data.clear();
+  downsample(*layout, mips);
+  return true;
+}
+
+bool TextureStreaming::add(unsigned int texture, const TextureUpload &upload, Source source) {
+  TextureUpload copy = upload;
+  std::vector<Mip> mips;
+  if (!build_mips(copy, mips)) {
+    return false;
+  }
+  return add(texture, copy, std::move(mips), std::move(source));
+}
+
+bool TextureStreaming::add(unsigned int texture, const TextureUpload &upload, std::vector<Mip> mips, Source source) {
+  std::optional<TexelLayout> layout = texel_layout(upload);
+  if (!layout) {
+    std::cout << "ERROR::TEXTURE_STREAMING::UNSUPPORTED_FORMAT " << upload.internal_format << std::endl;
+    return false;
+  }
+  if (mips.empty() || mips.back().width != 1 || mips.back().height != 1) {
+    std::cout << "ERROR::TEXTURE_STREAMING::INCOMPLETE_MIP_CHAIN" << std::endl;
+    return false;
+  }
+
+  auto previous = textures.find(texture);
+  if (previous != textures.end()) {
+    release(texture, previous->second);
+    textures.erase(previous);
+  }
+
+  StreamedTexture streamed {upload.internal_format, upload.format, upload.type, *layout};
+  streamed.mips = std::move(mips);
+  streamed.source = std::move(source);
+  for (const Mip& mip : streamed.mips) {
+    memory += mip.pixels.size();
+  }
+
+  int levels = streamed.mips.size();
+  streamed.initial_level = 0;
+  while (streamed.initial_level < levels - 1 &&
+         std::max(streamed.mips[streamed.initial_level].width, streamed.mips[streamed.initial_level].height) > initial_size) {
+    streamed.initial_level++;
+  }
+  // the initial levels count against the budget too; when even room for them cannot be
+  // made the texture starts coarser, down to its 1x1 level
+  size_t initial_bytes = 0;
+  for (int level = streamed.initial_level; level < levels; level++) {
+    initial_bytes += level_bytes(streamed, level);
+  }
+  while (!make_room(initial_bytes, texture) && streamed.initial_level < levels - 1) {
+    initial_bytes -= level_bytes(streamed, streamed.initial_level);
+    streamed.initial_level++;
+  }
+  streamed.wanted_level = streamed.initial_level;
+  streamed.resident_level = levels;
+  streamed.queued_level = levels;
+
+  state_cache.bind_texture(0, GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  // identity unless swizzled, which also resets a swizzle left by replaced contents
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, upload.swizzle);
+
+  // queued coarsest first; the scheduler keeps their pixels here, in the map
+  StreamedTexture& added = textures[texture] = std::move(streamed);
+  for (int level = levels - 1; level >= added.initial_level; level--) {
+    upload_level(texture, added, level);
+  }
+  trim_memory();
+  return true;
+}
+
+void TextureStreaming::request(unsigned int texture, float screen_width, float screen_height) {
+  auto found = textures.find(texture);
+  if (found == textures.end()) {
+    return;
+  }
+  StreamedTexture& streamed = found->second;
+  const Mip& base = streamed.mips[0];
+
+  // texels per pixel along the more minified axis picks the level the sampler will use
+  float ratio = std::max(base.width / std::max(screen_width, 1.0f), base.height / std::max(screen_height, 1.0f));
+  int level = ratio > 1.0f ? (int)std::floor(std::log2(ratio)) : 0;
+  level = std::min(level, streamed.initial_level);
+
+  // several draws in one frame keep the finest request
+  streamed.wanted_level = streamed.last_request == frame ? std::min(streamed.wanted_level, level) : level;
+  streamed.last_request = frame;
+}
+
+void TextureStreaming::update() {
+  for (auto& [texture, streamed] : textures) {
+    if (frame - streamed.last_request > IDLE_FRAMES) {
+      streamed.wanted_level = streamed.initial_level;
+    }
+  }
+
+  for (auto& [texture, streamed] : textures) {
+    if (streamed.rebuild.valid() && streamed.rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      finish_rebuild(streamed);
+    }
+    // one level at a time per texture, the next waits for the queued one to land
+    if (streamed.wanted_level >= streamed.resident_level || streamed.queued_level < streamed.resident_level) {
+      continue;
+    }
+    int level = streamed.resident_level - 1;
+    if (streamed.mips[level].pixels.empty()) {
+      // dropped from memory: rebuilt off this thread, uploaded on a later frame
+      if (!streamed.rebuild.valid()) {
+        streamed.rebuild = job_pool.async([source = streamed.source]() {
+          std::vector<Mip> mips;
+          return source(mips) ? mips : std::vector<Mip>();
+        });
+      }
+      continue;
+    }
+    if (make_room(level_bytes(streamed, level), texture)) {
+      upload_level(texture, streamed, level);
+    }
+  }
+  trim_memory();
+  frame++;
+}
+
+size_t TextureStreaming::resident_bytes() const {
+  return resident;
+}
+
+size_t TextureStreaming::memory_bytes() const {
+  return memory;
+}
+
+size_t TextureStreaming::rebuilt_chains() const {
+  return rebuilds;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+#include <glad/glad.h>
+#include <state_cache.h>
+#include <texture_format.h>
+
+#include <deque>
+#include <vector>
+#include <span>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+
+// Queues texture and buffer uploads and drains them under a per-frame byte and time
+// budget. Large textures go up in bands of rows with glTexSubImage2D and large buffers
+// in ranges with glBufferSubData, so loading while rendering never stalls a frame.
+class UploadScheduler {
+private:
+  // largest single glTexSubImage2D / glBufferSubData, so the time budget is checked often
+  const size_t BAND_BYTES = 256 * 1024;
+  struct PendingUpload {
+    bool texture {false};
+    unsigned int object {0};
+    GLenum target {0};
+    int level {0};
+    TextureUpload image {};              // texture uploads, its data empty when the pixels are borrowed
+    const unsigned char* pixels {nullptr}; // texture bytes, in `image` or borrowed from the caller
+    size_t size {0};                     // texture bytes
+    std::vector<unsigned char> data {};  // buffer uploads
+    GLenum usage {0};
+    size_t uploaded {0};                 // rows for textures, bytes for buffers
+    bool allocated {false};
+    std::function<void()> on_complete {};
+  };
+  size_t bytes_per_frame;
+  double microseconds_per_frame;
+  std::deque<PendingUpload> queue;
+
+  // uploads up to `bytes` of `pending` and returns how many were sent
+  size_t step(PendingUpload &pending, size_t bytes);
+public:
+  UploadScheduler(size_t bytes_per_frame = 4 * 1024 * 1024, double microseconds_per_frame = 2000.0);
+
+  // `on_complete` runs on the GL thread once the last band is uploaded, e.g. to build mips;
+  // false, and nothing queued, for an empty image
+  bool queue_texture(unsigned int texture, TextureUpload image, std::function<void()> on_complete = {});
+  // uploads `level` from `pixels`, laid out as `image` describes (its data is not used);
+  // `pixels` must stay valid until `on_complete` runs or the upload is cancelled
+  bool queue_texture_level(unsigned int texture, int level, const TextureUpload &image, std::span<const unsigned char> pixels,
+                           std::function<void()> on_complete = {});
+  void queue_buffer(unsigned int buffer, GLenum target, std::vector<unsigned char> data, GLenum usage, std::function<void()> on_complete = {});
+
+  // drops every queued upload of `object`, their `on_complete` never runs
+  void cancel(unsigned int object);
+
+  // call once per frame on the GL thread
+  void drain();
+
+  bool idle() const;
+  size_t pending_bytes() const;
+};
+
+UploadScheduler::UploadScheduler(size_t bytes_per_frame, double microseconds_per_frame)
+  : bytes_per_frame(bytes_per_frame), microseconds_per_frame(microseconds_per_frame) {}
+
+bool UploadScheduler::queue_texture(unsigned int texture, TextureUpload image, std::function<void()> on_complete) {
+  if (!queue_texture_level(texture, 0, image, image.data, std::move(on_complete))) {
+    return false;
+  }
+  // the pixels move with the vector, the pointer taken above stays valid
+  queue.back().image.data = std::move(image.data);
+  return true;
+}
+
+bool UploadScheduler::queue_texture_level(unsigned int texture, int level, const TextureUpload &image, std::span<const unsigned char> pixels,
+                                          std::function<void()> on_complete) {
+  // step() uploads whole rows, an image without any has nothing to split
+  if (image.width <= 0 || image.height <= 0 || pixels.empty()) {
+    std::cout << "ERROR::UPLOAD_SCHEDULER::EMPTY_TEXTURE " << image.width << "x" << image.height << std::endl;
+    return false;
+  }
+  PendingUpload pending;
+  pending.texture = true;
+  pending.object = texture;
+  pending.target = GL_TEXTURE_2D;
+  pending.level = level;
+  pending.image = {image.internal_format, image.format, image.type, image.width, image.height, image.swizzled};
+  std::copy(image.swizzle, image.swizzle + 4, pending.image.swizzle);
+  pending.pixels = pixels.data();
+  pending.size = pixels.size();
+  pending.on_complete = std::move(on_complete);
+  queue.push_back(std::move(pending));
+  return true;
+}
+
+void UploadScheduler::queue_buffer(unsigned int buffer, GLenum target, std::vector<unsigned char> data, GLenum usage, std::function<void()> on_complete) {
+  PendingUpload pending;
+  pending.object = buffer;
+  pending.target = target;
+  pending.data = std::move(data);
+  pending.usage = usage;
+  pending.on_complete = std::move(on_complete);
+  queue.push_back(std::move(pending));
+}
+
+void UploadScheduler::cancel(unsigned int object) {
+  std::erase_if(queue, [&](const PendingUpload& pending) { return pending.object == object; });
+}
+
+size_t UploadScheduler::step(PendingUpload &pending, size_t bytes) {
+  if (pending.texture) {
+    TextureUpload& image = pending.image;
+    state_cache.bind_texture(0, GL_TEXTURE_2D, pending.object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (!pending.allocated) {
+      glTexImage2D(GL_TEXTURE_2D, pending.level, image.internal_format, image.width, image.height, 0, image.format, image.type, NULL);
+      if (image.swizzled) {
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, image.swizzle);
+      }
+      pending.allocated = true;
+    }
+    // at least one row per step so a tiny budget still makes progress
+    size_t row_size = pending.size / image.height;
+    int rows = std::clamp<size_t>(bytes / row_size, 1, image.height - pending.uploaded);
+    glTexSubImage2D(GL_TEXTURE_2D, pending.level, 0, pending.uploaded, image.width, rows, image.format, image.type, &pending.pixels[pending.uploaded * row_size]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    pending.uploaded += rows;
+    return rows * row_size;
+  }
+
+  // element buffers bind to the current VAO, queue them with their VAO bound or use GL_COPY_WRITE_BUFFER
+  glBindBuffer(pending.target, pending.object);
+  if (!pending.allocated) {
+    glBufferData(pending.target, pending.data.size(), NULL, pending.usage);
+    pending.allocated = true;
+  }
+  if (pending.data.empty()) {
+    return 0;
+  }
+  size_t range = std::clamp<size_t>(bytes, 1, pending.data.size() - pending.uploaded);
+  glBufferSubData(pending.target, pending.uploaded, range, &pending.data[pending.uploaded]);
+  pending.uploaded += range;
+  return range;
+}
+
+void UploadScheduler::drain() {
+  auto start = std::chrono::steady_clock::now();
+  size_t sent = 0;
+  while (!queue.empty() && sent < bytes_per_frame) {
+    PendingUpload& pending = queue.front();
+    sent += step(pending, std::min(bytes_per_frame - sent, BAND_BYTES));
+
+    size_t total = pending.texture ? pending.image.height : pending.data.size();
+    if (pending.uploaded == total) {
+      // off the queue first, the callback may queue or cancel uploads
+      std::function<void()> on_complete = std::move(pending.on_complete);
+      queue.pop_front();
+      if (on_complete) {
+        on_complete();
+      }
+    }
+
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed.count() >= microseconds_per_frame) {
+      break;
+    }
+  }
+}
+
+bool UploadScheduler::idle() const {
+  return queue.empty();
+}
+
+size_t UploadScheduler::pending_bytes() const {
+  size_t bytes = 0;
+  for (const PendingUpload& pending : queue) {
+    if (pending.texture) {
+      bytes += pending.size - pending.uploaded * (pending.size / pending.image.height);
+    }
+    else {
+      bytes += pending.data.size() - pending.uploaded;
+    }
+  }
+  return bytes;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef VERTEX_STREAM_H
+#define VERTEX_STREAM_H
+
+#include <glad/glad.h>
+#include <shader.h>
+
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+
+struct VertexAttribute {
+  unsigned int location;
+  int components; // float components
+};
+
+struct VertexStreamBuffers {
+  unsigned int vertex_array;
+  unsigned int vertex_buffer;
+  int source_stride;        // bytes per vertex with every attribute
+  int stride;               // bytes per vertex after pruning
+  int bytes_saved_per_draw; // compared to uploading every attribute
+};
+
+// interleaved float vertices that are re-packed per program, keeping only the attributes it reads
+class VertexStream {
+private:
+  std::vector<VertexAttribute> attributes;
+  std::vector<float> vertices;
+  int stride {0}; // floats per source vertex
+public:
+  VertexStream(const float* data, size_t size, std::initializer_list<VertexAttribute> layout);
+
+  size_t vertex_count() const;
+
+  // builds a VAO holding only the attributes `shader` reads and attaches `element_buffer` to it
+  VertexStreamBuffers build(const Shader& shader, unsigned int element_buffer) const;
+};
+
+VertexStream::VertexStream(const float* data, size_t size, std::initializer_list<VertexAttribute> layout)
+  : attributes(layout), vertices(data, data + size / sizeof(float)) {
+  for (const VertexAttribute& attribute : attributes) {
+    stride += attribute.components;
+  }
+}
+
+size_t VertexStream::vertex_count() const {
+  return stride ? vertices.size() / stride : 0;
+}
+
+VertexStreamBuffers VertexStream::build(const Shader& shader, unsigned int element_buffer) const {
+  std::vector<unsigned int> active = shader.active_attribute_locations();
+
+  // source offset of every kept attribute, in floats
+  std::vector<std::pair<VertexAttribute, int>> kept;
+  int kept_stride = 0;
+  int offset = 0;
+  for (const VertexAttribute& attribute : attributes) {
+    if (std::find(active.begin(), active.end(), attribute.location) != active.end()) {
+      kept.push_back({attribute, offset});
+      kept_stride += attribute.components;
+    }
+    offset += attribute.components;
+  }
+
+  size_t count = vertex_count();
+  std::vector<float> packed;
+  packed.reserve(count * kept_stride);
+  for (size_t vertex = 0; vertex < count; vertex++) {
+    const float* source = &vertices[vertex * stride];
+    for (const auto& [attribute, source_offset] : kept) {
+      packed.insert(packed.end(), source + source_offset, source + source_offset + attribute.components);
+    }
+  }
+
+  VertexStreamBuffers buffers;
+  buffers.source_stride = stride * sizeof(float);
+  buffers.stride = kept_stride * sizeof(float);
+  buffers.bytes_saved_per_draw = (stride - kept_stride) * sizeof(float) * count;
+
+  glGenVertexArrays(1, &buffers.vertex_array);
+  glGenBuffers(1, &buffers.vertex_buffer);
+  glBindVertexArray(buffers.vertex_array);
+  glBindBuffer(GL_ARRAY_BUFFER, buffers.vertex_buffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+  glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(float), packed.data(), GL_STATIC_DRAW);
+
+  offset = 0;
+  for (const auto& [attribute, source_offset] : kept) {
+    glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE, buffers.stride, (void*)(offset * sizeof(float)));
+    glEnableVertexAttribArray(attribute.location);
+    offset += attribute.components;
+  }
+  return buffers;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef VIRTUAL_FILESYSTEM_H
+#define VIRTUAL_FILESYSTEM_H
+
+#include <async_reader.h>
+#include <pack_archive.h>
+
+#include <sys/stat.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+// One namespace of asset paths over several mounts: directories on disk, packs and
+// tables of in-memory files (the embedded assets). A path is served by the mount with
+// the highest priority that has it, the most recent mount winning ties, so a directory
+// mounted over a pack overrides single files. Paths are normalized and interned, and
+// each one is resolved once, including misses, so repeated lookups never stat or open.
+// Safe to use from several threads; returned bytes stay valid and never move.
+class VirtualFilesystem {
+public:
+  using PathId = uint32_t;
+private:
+  enum class MountKind {
+    directory,
+    pack,
+    memory,
+  };
+  struct Mount {
+    MountKind kind;
+    std::string prefix;                                          // "" or ends with '/'
+    int priority;
+    std::string directory {};                                    // absolute
+    std::unique_ptr<PackArchive> pack {};
+    std::map<std::string, std::span<const unsigned char>, std::less<>> files {}; // memory mounts
+  };
+  struct Resolution {
+    bool resolved {false};
+    const Mount* mount {nullptr}; // null when no mount has the path
+    std::string location;         // file on disk, or the name inside a pack or table
+  };
+  std::vector<std::unique_ptr<Mount>> mounts; // by descending priority, then newest first
+  std::deque<std::string> paths;              // normalized, by id; deques keep addresses stable
+  std::deque<std::string> aliases;            // other spellings of interned paths
+  std::unordered_map<std::string_view, PathId> ids;
+  std::vector<Resolution> resolutions;
+  std::map<std::string, std::vector<unsigned char>> loaded; // by file on disk
+  std::mutex mutex;
+
+  static std::string normalize(std::string_view path);
+  static std::string normalize_prefix(std::string_view prefix);
+  void add(std::unique_ptr<Mount> mount);
+  bool has(const Mount &mount, const std::string &inside, std::string &location) const;
+  const Resolution& resolve(PathId id);
+  std::string resolved_disk_path(PathId id);
+public:
+  VirtualFilesystem() = default;
+  VirtualFilesystem(const VirtualFilesystem&) = delete;
+  VirtualFilesystem& operator=(const VirtualFilesystem&) = delete;
+
+  // `prefix` places the mount in the namespace, e.g. "textures" serves "textures/x.png"
+  // from "<directory>/x.png"; relative directories are taken from the working directory
+  bool mount_directory(const std::string &directory, std::string_view prefix = "", int priority = 0);
+  bool mount_pack(const std::string &path, std::string_view prefix = "", int priority = 0);
+  // the bytes `files` points at must outlive the filesystem
+  void mount_memory(const std::map<std::string, std::span<const unsigned char>> &files, std::string_view prefix = "", int priority = 0);
+
+  PathId intern(std::string_view path);
+
+  // the file's bytes, kept until the filesystem goes away; empty when no mount has it
+  std::span<const unsigned char> read(PathId id);
+  bool exists(PathId id);
+
+  // the file backing `id` when a directory mount serves it, otherwise empty
+  std::string disk_path(PathId id);
+
+  // reads every directory-backed file not read yet in one concurrent batch
+  size_t preload(AsyncReader &reader, const std::vector<PathId> &ids);
+};
+
+std::string VirtualFilesystem::normalize(std::string_view path) {
+  // "a//b/./c/../d" -> "a/b/d"; ".." never climbs above the root of the namespace
+  std::vector<std::string_view> parts;
+  while (!path.empty()) {
+    size_t slash = path.find('/');
+    std::string_view part = path.substr(0, slash);
+    path = slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1);
+    if (part.empty() || part == ".") {
+      continue;
+    }
+    if (part == "..") {
+      if (!parts.empty()) {
+        parts.pop_back();
+      }
+      continue;
+    }
+    parts.push_back(part);
+  }
+  std::string normalized;
+  for (std::string_view part : parts) {
+    normalized += normalized.empty() ? "" : "/";
+    normalized += part;
+  }
+  return normalized;
+}
+
+std::string VirtualFilesystem::normalize_prefix(std::string_view prefix) {
+  std::string normalized = normalize(prefix);
+  return normalized.empty() ? normalized : normalized + "/";
+}
+
+void VirtualFilesystem::add(std::unique_ptr<Mount> mount) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto position = std::find_if(mounts.begin(), mounts.end(), [&](const std::unique_ptr<Mount>& other) { return other->priority <= mount->priority; });
+  mounts.insert(position, std::move(mount));
+  // every cached resolution may now be shadowed
+  for (Resolution& resolution : resolutions) {
+    resolution = {};
+  }
+}
+
+bool VirtualFilesystem::mount_directory(const std::string &directory, std::string_view prefix, int priority) {
+  std::error_code error;
+  std::filesystem::path absolute = std::filesystem::absolute(directory, error);
+  if (error || !std::filesystem::is_directory(absolute, error)) {
+    std::cout << "ERROR::VIRTUAL_FILESYSTEM::NOT_A_DIRECTORY " << directory << std::endl;
+    return false;
+  }
+  auto mount = std::make_unique<Mount>(Mount {MountKind::directory, normalize_prefix(prefix), priority});
+  mount->directory = absolute.lexically_normal().string();
+  if (mount->directory.size() > 1 && mount->directory.back() == '/') {
+    mount->directory.pop_back();
+  }
+  add(std::move(mount));
+  return true;
+}
+
+bool VirtualFilesystem::mount_pack(const std::string &path, std::string_view prefix, int priority) {
+  auto mount = std::make_unique<Mount>(Mount {MountKind::pack, normalize_prefix(prefix), priority});
+  mount->pack = std::make_unique<PackArchive>();
+  if (!mount->pack->open(path)) {
+    return false;
+  }
+  add(std::move(mount));
+  return true;
+}
+
+void VirtualFilesystem::mount_memory(const std::map<std::string, std::span<const unsigned char>> &files, std::string_view prefix, int priority) {
+  auto mount = std::make_unique<Mount>(Mount {MountKind::memory, normalize_prefix(prefix), priority});
+  for (const auto& [name, bytes] : files) {
+    mount->files.emplace(normalize(name), bytes);
+  }
+  add(std::move(mount));
+}
+
+VirtualFilesystem::PathId VirtualFilesystem::intern(std::string_view path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = ids.find(path);
+  if (found != ids.end()) {
+    return found->second;
+  }
+  // both the spelling asked for and the normalized one map to the same id
+  std::string normalized = normalize(path);
+  auto canonical = ids.find(normalized);
+  PathId id;
+  if (canonical != ids.end()) {
+    id = canonical->second;
+  }
+  else {
+    id = resolutions.size();
+    paths.push_back(normalized);
+    ids.emplace(paths.back(), id);
+    resolutions.emplace_back();
+  }
+  if (path != normalized) {
+    aliases.emplace_back(path);
+    ids.emplace(aliases.back(), id);
+  }
+  return id;
+}
+
+bool VirtualFilesystem::has(const Mount &mount, const std::string &inside, std::string &location) const {
+  switch (mount.kind) {
+  case MountKind::directory: {
+    struct stat status;
+    location = mount.directory + "/" + inside;
+    return stat(location.c_str(), &status) == 0 && S_ISREG(status.st_mode);
+  }
+  case MountKind::pack:
+    location = inside;
+    return mount.pack->contains(inside);
+  case MountKind::memory:
+    location = inside;
+    return mount.files.count(inside) > 0;
+  }
+  return false;
+}
+
+const VirtualFilesystem::Resolution& VirtualFilesystem::resolve(PathId id) {
+  Resolution& resolution = resolutions[id];
+  if (resolution.resolved) {
+    return resolution;
+  }
+  const std::string& path = paths[id];
+  resolution.resolved = true;
+  for (const std::unique_ptr<Mount>& mount : mounts) {
+    if (path.compare(0, mount->prefix.size(), mount->prefix) != 0) {
+      continue;
+    }
+    if (has(*mount, path.substr(mount->prefix.size()), resolution.location)) {
+      resolution.mount = mount.get();
+      return resolution;
+    }
+  }
+  resolution.location.clear();
+  return resolution;
+}
+
+std::span<const unsigned char> VirtualFilesystem::read(PathId id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const Resolution& resolution = resolve(id);
+  if (!resolution.mount) {
+    return {};
+  }
+  switch (resolution.mount->kind) {
+  case MountKind::directory: {
+    auto found = loaded.find(resolution.location);
+    if (found == loaded.end()) {
+      std::ifstream file(resolution.location, std::ios::binary);
+      if (!file) {
+        return {};
+      }
+      found = loaded.emplace(resolution.location, std::vector<unsigned char>(std::istreambuf_iterator<char>(file), {})).first;
+    }
+    return found->second;
+  }
+  case MountKind::pack:
+    return resolution.mount->pack->get(resolution.location);
+  case MountKind::memory:
+    return resolution.mount->files.find(resolution.location)->second;
+  }
+  return {};
+}
+
+bool VirtualFilesystem::exists(PathId id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return resolve(id).mount != nullptr;
+}
+
+std::string VirtualFilesystem::disk_path(PathId id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return resolved_disk_path(id);
+}
+
+std::string VirtualFilesystem::resolved_disk_path(PathId id) {
+  const Resolution& resolution = resolve(id);
+  return resolution.mount && resolution.mount->kind == MountKind::directory ? resolution.location : std::string();
+}
+
+size_t VirtualFilesystem::preload(AsyncReader &reader, const std::vector<PathId> &ids) {
+  std::vector<std::string> files;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (PathId id : ids) {
+      std::string file = resolved_disk_path(id);
+      if (!file.empty() && !loaded.count(file) && std::find(files.begin(), files.end(), file) == files.end()) {
+        files.push_back(file);
+      }
+    }
+  }
+  // other threads keep resolving and reading while the batch is in flight
+  std::vector<std::vector<unsigned char>> buffers;
+  return reader.read(files, buffers, [&](size_t index, bool ok) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ok) {
+      loaded.emplace(files[index], std::move(buffers[index]));
+    }
+  });
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef WORLD_STREAMING_H
+#define WORLD_STREAMING_H
+
+#include <glad/glad.h>
+#include <shader.h>
+#include <scene_file.h>
+#include <scene_geometry.h>
+#include <upload_scheduler.h>
+#include <job_pool.h>
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// A world cut into square chunks of `chunk_size` units, each a compiled scene named
+// chunk_<x>_<y>.scn in one directory, with vertices in world units. Chunks whose centre
+// is within `load_radius` of the camera are read and copied out of their mapping on the
+// job pool, nearest first and a few at a time, then queued on the caller's
+// UploadScheduler, sharing its per-frame budget with everything else it uploads. Chunks
+// beyond `unload_radius` are evicted, their queued uploads dropped;
+// the gap between the two radii keeps a camera on a chunk border from loading and
+// evicting the same chunks every frame. Loads that fall out of range are cancelled.
+class WorldStreaming {
+private:
+  using ChunkKey = std::pair<int, int>;
+  // what a worker hands back: the meshes and copies of their sections
+  struct LoadedChunk {
+    std::vector<SceneMesh> meshes;
+    std::vector<std::vector<unsigned char>> vertices;
+    std::vector<std::vector<unsigned char>> indices;
+  };
+  enum class ChunkState {
+    queued,    // wanted, waiting for a load slot
+    loading,   // on the job pool
+    uploading, // buffers queued on the scheduler
+    resident,
+  };
+  struct Chunk {
+    ChunkState state {ChunkState::queued};
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    std::future<LoadedChunk> load;
+    std::vector<SceneMeshBuffers> meshes;
+    std::shared_ptr<size_t> pending_uploads;
+    size_t bytes {0};
+  };
+  std::string directory;
+  float chunk_size;
+  float load_radius;
+  float unload_radius;
+  unsigned int max_loads;
+  std::vector<unsigned int> active_attributes;
+  UploadScheduler& uploads;
+  std::map<ChunkKey, Chunk> chunks;
+  size_t resident {0};
+public:
+  struct Statistics {
+    size_t loads {0};
+    size_t cancelled_loads {0};
+    size_t evictions {0};
+    size_t uploaded_bytes {0};
+    double worst_update_ms {0.0}; // the longest update(), the hitch streaming adds to a frame
+  };
+private:
+  Statistics stats;
+
+  float distance(ChunkKey key, float camera_x, float camera_y) const;
+  std::string chunk_path(ChunkKey key) const;
+  static LoadedChunk load_chunk(const std::string &path, const std::atomic<bool> &cancelled);
+  void start_upload(Chunk &chunk, LoadedChunk loaded);
+  void evict(Chunk &chunk);
+public:
+  // `shader` decides which attributes of the chunk meshes are enabled; `uploads` is drained
+  // by the caller after update() and must outlive the streamer
+  WorldStreaming(const std::string &directory, const Shader &shader, UploadScheduler &uploads, float chunk_size, float load_radius,
+                 float unload_radius, unsigned int max_loads = 4);
+  WorldStreaming(const WorldStreaming&) = delete;
+  WorldStreaming& operator=(const WorldStreaming&) = delete;
+  ~WorldStreaming();
+
+  // call once per frame on the GL thread, with the camera in world units
+  void update(float camera_x, float camera_y);
+
+  // calls `draw(vertex_array, index_count)` for every mesh of every resident chunk
+  template <typename Draw>
+  void draw(Draw draw) const;
+
+  size_t resident_chunks() const;
+  size_t resident_bytes() const;
+  const Statistics& statistics() const;
+};
+
+WorldStreaming::WorldStreaming(const std::string &directory, const Shader &shader, UploadScheduler &uploads, float chunk_size,
+                               float load_radius, float unload_radius, unsigned int max_loads)
+  : directory(directory), chunk_size(chunk_size), load_radius(load_radius), unload_radius(std::max(unload_radius, load_radius + chunk_size)),
+    max_loads(std::max(max_loads, 1u)), active_attributes(shader.active_attribute_locations()), uploads(uploads) {}
+
+WorldStreaming::~WorldStreaming() {
+  for (auto& [key, chunk] : chunks) {
+    if (chunk.cancelled) {
+      *chunk.cancelled = true;
+    }
+    evict(chunk);
+  }
+}
+
+float WorldStreaming::distance(ChunkKey key, float camera_x, float camera_y) const {
+  return std::hypot((key.first + .5f) * chunk_size - camera_x, (key.second + .5f) * chunk_size - camera_y);
+}
+
+std::string WorldStreaming::chunk_path(ChunkKey key) const {
+  return directory + "/chunk_" + std::to_string(key.first) + "_" + std::to_string(key.second) + ".scn";
+}
+
+WorldStreaming::LoadedChunk WorldStreaming::load_chunk(const std::string &path, const std::atomic<bool> &cancelled) {
+  LoadedChunk loaded;
+  struct stat status;
+  // past the edge of the world there are no chunks, which is not an error
+  if (cancelled || stat(path.c_str(), &status) != 0) {
+    return loaded;
+  }
+  SceneFile scene;
+  if (!scene.open(path)) {
+    return loaded;
+  }
+  // copied out here, off the GL thread, so the mapping is gone before the upload starts
+  for (const SceneMesh& mesh : scene.meshes()) {
+    if (cancelled) {
+      return {};
+    }
+    std::span<const float> vertices = scene.vertices(mesh);
+    std::span<const uint32_t> indices = scene.indices(mesh);
+    loaded.meshes.push_back(mesh);
+    loaded.vertices.emplace_back((const unsigned char*)vertices.data(), (const unsigned char*)(vertices.data() + vertices.size()));
+    loaded.indices.emplace_back((const unsigned char*)indices.data(), (const unsigned char*)(indices.data() + indices.size()));
+  }
+  return loaded;
+}
+
+void WorldStreaming::start_upload(Chunk &chunk, LoadedChunk loaded) {
+  int previous_vertex_array;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+  chunk.pending_uploads = std::make_shared<size_t>(loaded.meshes.size() * 2);
+  for (size_t i = 0; i < loaded.meshes.size(); i++) {
+    SceneMeshBuffers mesh_buffers {0, 0, 0, (int)loaded.meshes[i].index_count};
+    glGenVertexArrays(1, &mesh_buffers.vertex_array);
+    glGenBuffers(1, &mesh_buffers.vertex_buffer);
+    glGenBuffers(1, &mesh_buffers.element_buffer);
+    // the VAO only records which buffers it reads, their storage arrives later
+    glBindVertexArray(mesh_buffers.vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh_buffers.vertex_buffer);
+    SceneGeometry::set_attributes(loaded.meshes[i], active_attributes);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_buffers.element_buffer);
+
+    chunk.bytes += loaded.vertices[i].size() + loaded.indices[i].size();
+    // GL_COPY_WRITE_BUFFER leaves the bound VAO and its element buffer alone
+    auto uploaded = [pending = chunk.pending_uploads]() { --*pending; };
+    uploads.queue_buffer(mesh_buffers.vertex_buffer, GL_COPY_WRITE_BUFFER, std::move(loaded.vertices[i]), GL_STATIC_DRAW, uploaded);
+    uploads.queue_buffer(mesh_buffers.element_buffer, GL_COPY_WRITE_BUFFER, std::move(loaded.indices[i]), GL_STATIC_DRAW, uploaded);
+    chunk.meshes.push_back(mesh_buffers);
+  }
+  glBindVertexArray(previous_vertex_array);
+  chunk.state = ChunkState::uploading;
+}
+
+void WorldStreaming::evict(Chunk &chunk) {
+  for (const SceneMeshBuffers& mesh_buffers : chunk.meshes) {
+    // the scheduler outlives the chunk, what it still holds for these buffers must not reach them
+    uploads.cancel(mesh_buffers.vertex_buffer);
+    uploads.cancel(mesh_buffers.element_buffer);
+    glDeleteVertexArrays(1, &mesh_buffers.vertex_array);
+    glDeleteBuffers(1, &mesh_buffers.vertex_buffer);
+    glDeleteBuffers(1, &mesh_buffers.element_buffer);
+  }
+  chunk.meshes.clear();
+  if (chunk.state == ChunkState::resident) {
+    resident -= chunk.bytes;
+  }
+  chunk.bytes = 0;
+}
+
+void WorldStreaming::update(float camera_x, float camera_y) {
+  auto start = std::chrono::steady_clock::now();
+
+  // evict and cancel past the unload radius, chunks mid-upload included
+  for (auto it = chunks.begin(); it != chunks.end();) {
+    Chunk& chunk = it->second;
+    if (distance(it->first, camera_x, camera_y) <= unload_radius) {
+      ++it;
+      continue;
+    }
+    if (chunk.state == ChunkState::loading) {
+      // the worker notices between meshes; its result is dropped with the future
+      *chunk.cancelled = true;
+      stats.cancelled_loads++;
+    }
+    else if (chunk.state == ChunkState::uploading || chunk.state == ChunkState::resident) {
+      evict(chunk);
+      stats.evictions++;
+    }
+    it = chunks.erase(it);
+  }
+
+  // every chunk within the load radius is wanted
+  int first_x = std::floor((camera_x - load_radius) / chunk_size);
+  int last_x = std::floor((camera_x + load_radius) / chunk_size);
+  int first_y = std::floor((camera_y - load_radius) / chunk_size);
+  int last_y = std::floor((camera_y + load_radius) / chunk_size);
+  for (int x = first_x; x <= last_x; x++) {
+    for (int y = first_y; y <= last_y; y++) {
+      if (distance({x, y}, camera_x, camera_y) <= load_radius) {
+        chunks.try_emplace({x, y});
+      }
+    }
+  }
+
+  // finished loads go to the scheduler, chunks whose last buffer it has uploaded become drawable
+  unsigned int loading = 0;
+  for (auto& [key, chunk] : chunks) {
+    if (chunk.state == ChunkState::loading && chunk.load.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      start_upload(chunk, chunk.load.get());
+      stats.loads++;
+    }
+    if (chunk.state == ChunkState::uploading && *chunk.pending_uploads == 0) {
+      chunk.state = ChunkState::resident;
+      resident += chunk.bytes;
+      stats.uploaded_bytes += chunk.bytes;
+    }
+    loading += chunk.state == ChunkState::loading;
+  }
+
+  // free load slots go to the nearest queued chunks, re-ranked every frame as the camera moves
+  if (loading < max_loads) {
+    std::vector<std::pair<float, ChunkKey>> queued;
+    for (const auto& [key, chunk] : chunks) {
+      if (chunk.state == ChunkState::queued) {
+        queued.emplace_back(distance(key, camera_x, camera_y), key);
+      }
+    }
+    size_t count = std::min<size_t>(max_loads - loading, queued.size());
+    std::partial_sort(queued.begin(), queued.begin() + count, queued.end());
+    for (size_t i = 0; i < count; i++) {
+      Chunk& chunk = chunks[queued[i].second];
+      chunk.cancelled = std::make_shared<std::atomic<bool>>(false);
+      chunk.load = job_pool.async([path = chunk_path(queued[i].second), cancelled = chunk.cancelled]() {
+        return load_chunk(path, *cancelled);
+      });
+      chunk.state = ChunkState::loading;
+    }
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  stats.worst_update_ms = std::max(stats.worst_update_ms, elapsed.count());
+}
+
+template <typename Draw>
+void WorldStreaming::draw(Draw draw) const {
+  for (const auto& [key, chunk] : chunks) {
+    if (chunk.state != ChunkState::resident) {
+      continue;
+    }
+    for (const SceneMeshBuffers& mesh_buffers : chunk.meshes) {
+      draw(mesh_buffers.vertex_array, mesh_buffers.index_count);
+    }
+  }
+}
+
+size_t WorldStreaming::resident_chunks() const {
+  return std::count_if(chunks.begin(), chunks.end(), [](const auto& entry) { return entry.second.state == ChunkState::resident; });
+}
+
+size_t WorldStreaming::resident_bytes() const {
+  return resident;
+}
+
+const WorldStreaming::Statistics& WorldStreaming::statistics() const {
+  return stats;
+}
+
+#endif
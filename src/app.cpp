@@ -1,7 +1,44 @@
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <array>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <map>
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdlib>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <shader.h>
+#include <vertex_stream.h>
+#include <shader_warmup.h>
+#include <state_cache.h>
+#include <sampler_registry.h>
+#include <texture_format.h>
+#include <texture_streaming.h>
+#include <texture_atlas.h>
+#include <texture_array.h>
+#include <upload_scheduler.h>
+#include <image_resampler.h>
+#include <material_baker.h>
+#include <sprite_mesh.h>
+#include <texture_cache.h>
+#include <texture_reloader.h>
+#include <procedural_texture.h>
+#include <scene_file.h>
+#include <scene_geometry.h>
+#include <world_streaming.h>
+#include <job_pool.h>
+#include <asset_tasks.h>
+#include <decode_arena.h>
+// stb_image allocates from the loading thread's arena, rewound after every upload
+#define STBI_MALLOC(size) decode_arena.allocate(size)
+#define STBI_REALLOC(pointer, size) decode_arena.reallocate(pointer, size)
+#define STBI_FREE(pointer) decode_arena.release(pointer)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -10,11 +47,151 @@ const struct {
   short y {600};
 } SIZE;
 
+// largest texture side kept at load, lower it for low-memory deployments
+const int MAX_TEXTURE_SIZE {2048};
+
+// an image as stb_image decoded it, top row first, clamped to MAX_TEXTURE_SIZE
+struct DecodedImage {
+  int width {0};
+  int height {0};
+  int channels {0};
+  std::vector<unsigned char> pixels; // empty when decoding failed
+  std::chrono::steady_clock::time_point finished;
+};
+
+// a texture a material binds to one of its sampler uniforms
+struct MaterialTexture {
+  std::string sampler;
+  std::string name; // asset
+  SamplerDescription sampling;
+};
+
+// the shaders and textures the scene's instances are drawn with
+struct DrawMaterial {
+  std::string vertex_shader;
+  std::string fragment_shader;
+  std::vector<MaterialTexture> textures;
+};
+
+// where a sprite samples its image: a rectangle of a texture, and a layer for arrays
+struct SpriteRegion {
+  float u0;
+  float v0;
+  float u1;
+  float v1;
+  float layer;
+  SpriteMesh mesh; // outline of the visible texels, in the image's own [0, 1] coords
+};
+
+// sprites drawn with one call: positions at location 0, texture coords at 2, layers at 3
+struct SpriteBatch {
+  unsigned int vertex_array {0};
+  unsigned int buffers[2] {};
+  int index_count {0};
+};
+
 // function prototypes
 void framebuffer_size_callback(GLFWwindow* window, int width, int heigth);
 void process_input(GLFWwindow* window);
+bool has_flag(int argc, char* argv[], const char* flag);
+double fill_benchmark(Shader &shader, int draws, int index_count);
+void report_overdraw(Shader &shader, const char* name);
+SpriteBatch build_sprite_batch(const std::vector<SpriteRegion> &regions, int count);
+DecodedImage decode_image(const unsigned char* bytes, size_t size);
+bool decode_mips(const unsigned char* bytes, size_t size, std::vector<TextureStreaming::Mip> &mips);
+Task<> preload_assets(std::shared_ptr<AsyncReader> reader, std::vector<std::string> names, size_t &preloaded);
+Task<> decode_startup_image(AssetTasks &tasks, TaskHandle preload, std::string name, DecodedImage &image);
+Task<> load_sprite_image(AssetTasks &tasks, std::string name, int size, std::function<void(const DecodedImage &image, const SpriteMesh &mesh)> add);
+
+int main(int argc, char* argv[]) {
+  auto process_start = std::chrono::steady_clock::now();
+  // time to first frame, split into the phases the main thread goes through
+  std::vector<std::pair<const char*, double>> startup_phases;
+  auto phase_start = process_start;
+  auto end_phase = [&](const char* name) {
+    auto now = std::chrono::steady_clock::now();
+    startup_phases.emplace_back(name, std::chrono::duration<double, std::milli>(now - phase_start).count());
+    phase_start = now;
+  };
+
+  // sampling state lives in shared sampler objects bound per unit, not in each texture
+  const SamplerDescription clamped {GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_LINEAR, GL_LINEAR};
+  const SamplerDescription repeated {GL_REPEAT, GL_REPEAT, GL_LINEAR, GL_LINEAR};
+
+  // the scene names the quad's mesh, the material it is drawn with and where its instances
+  // go; it ships as the `scenes/quad.scn` asset, embedded and packed, and is read in place.
+  // `SCENE` names a compiled scene file to mmap instead. Without either the quad's arrays
+  // below and this material stand in
+  DrawMaterial material {"src/shader.vs", "src/shader.fs", {
+    {"container", "textures/container.jpg", clamped},
+    {"awesomeface", "textures/awesomeface.png", repeated},
+  }};
+  SceneFile scene;
+  if (const char* scene_path = std::getenv("SCENE")) {
+    scene.open(scene_path);
+  }
+  else if (assets.filesystem().exists(assets.filesystem().intern("scenes/quad.scn"))) {
+    Asset scene_asset = assets.get("scenes/quad.scn");
+    scene.open({scene_asset.data, scene_asset.size}, "scenes/quad.scn");
+  }
+  if (scene.is_open() && scene.instances().empty()) {
+    scene.close();
+  }
+  // the material of the first instance; instances with another one are not drawn
+  uint32_t scene_material = scene.is_open() ? scene.instances()[0].material : SCENE_NONE;
+  if (scene_material != SCENE_NONE) {
+    const SceneMaterial& source = scene.materials()[scene_material];
+    material = {std::string(scene.string(source.vertex_shader)), std::string(scene.string(source.fragment_shader)), {}};
+    for (const SceneTexture& texture : scene.textures(source)) {
+      material.textures.push_back({std::string(scene.string(texture.sampler)), std::string(scene.string(texture.asset)),
+                                   {texture.wrap_s, texture.wrap_t, GL_LINEAR, GL_LINEAR}});
+    }
+  }
+
+  // assets read from disk arrive in one concurrent batch, and the images are decoded on the
+  // job pool, all while the window, the context and GLAD are set up
+  // shared with the task, which may outlive main()'s use of the reader
+  auto reader = std::make_shared<AsyncReader>();
+  struct StartupDecode {
+    TaskHandle task;
+    DecodedImage image;
+  };
+  // declared before the tasks, whose destructor may still finish the preload or a decode
+  size_t preloaded {0};
+  std::map<std::string, StartupDecode> decodes;
+  AssetTasks tasks;
+  std::vector<std::string> preload_names {material.vertex_shader, material.fragment_shader, "src/shader_baked.fs"};
+  for (const MaterialTexture& texture : material.textures) {
+    preload_names.push_back(texture.name);
+  }
+  TaskHandle preload = tasks.spawn(preload_assets(reader, preload_names, preloaded), 3);
+  // the image uploaded first is decoded first
+  int priority = 2;
+  for (const MaterialTexture& texture : material.textures) {
+    if (!decodes.count(texture.name)) {
+      StartupDecode& decode = decodes[texture.name];
+      decode.task = tasks.spawn(decode_startup_image(tasks, preload, texture.name, decode.image), priority--);
+    }
+  }
+  // the startup decode of `name` when there is one, otherwise decoded on the spot
+  auto take_decoded = [&](const std::string &name) {
+    auto found = decodes.find(name);
+    if (found == decodes.end()) {
+      Asset image = assets.get(name);
+      return decode_image(image.data, image.size);
+    }
+    // the GL thread is blocked on this one, it goes ahead of the other decodes from its next hop
+    found->second.task.set_priority(3);
+    tasks.wait(found->second.task);
+    DecodedImage decoded = std::move(found->second.image);
+    decodes.erase(found);
+    return decoded;
+  };
+  std::optional<std::chrono::steady_clock::time_point> decodes_finished;
+
+  // `--no-warmup` skips shader pre-warming, to compare first-frame times
+  bool warm_up = !has_flag(argc, argv, "--no-warmup");
 
-int main() {
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -28,19 +205,49 @@ int main() {
   }
   glfwMakeContextCurrent(window);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  end_phase("window");
 
   if (!gladLoadGLLoader(GLADloadproc(glfwGetProcAddress))) {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
 
-  Shader shader("/home/hiro/rote/cpp-opengl/project/src/shader.vs", "/home/hiro/rote/cpp-opengl/project/src/shader.fs");
+  // compile each stage once and mix them with pipeline objects instead of linking every pair
+  if (Shader::enable_separable(GLADloadproc(glfwGetProcAddress))) {
+    std::cout << "Using separable shader programs" << std::endl;
+  }
+  end_phase("GLAD");
+
+  // the material's fragment shader may mix two textures by a constant; unless `--live-mix` is given that blend
+  // is baked into one texture at load and sampled once by a single-texture variant
+  // `--procedural` generates a checker on the GPU in place of the first texture; baking needs
+  // both images on the CPU, so it implies `--live-mix`
+  bool procedural = has_flag(argc, argv, "--procedural");
+  std::optional<StaticBlend> blend;
+  if (!has_flag(argc, argv, "--live-mix") && !procedural) {
+    blend = MaterialBaker::detect(assets.get(material.fragment_shader).text());
+  }
+  auto find_texture = [&](const std::string &sampler) {
+    return std::find_if(material.textures.begin(), material.textures.end(), [&](const MaterialTexture& texture) { return sampler == texture.sampler; });
+  };
+  // the material has to bind both blended samplers for the bake to stand in for it
+  if (blend && (find_texture(blend->first) == material.textures.end() || find_texture(blend->second) == material.textures.end())) {
+    blend.reset();
+  }
+  Shader shader(material.vertex_shader.c_str(), blend ? "src/shader_baked.fs" : material.fragment_shader.c_str());
+  end_phase("shaders");
 
   // show maximum number of vertex attributes supported
   int nr_attributes ;
   glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &nr_attributes);
   std::cout << "Maximum nr of vertex attributes supported: " << nr_attributes << std::endl;
 
+  // the scene's vertex and index sections are uploaded straight from the mapping or asset
+  std::optional<SceneGeometry> scene_geometry;
+  if (scene.is_open()) {
+    scene_geometry.emplace(scene, shader);
+  }
+
   float vertices[] {
     // positions      // colors         // texture coords
     .5f, .5f, .0f,    1.0f, .0f, .0f,   2.0f, 2.0f,
@@ -54,106 +261,487 @@ int main() {
     1, 2, 3, // second triangle
   };
 
-  unsigned int vertex_array_object;
-  unsigned int vertex_buffer_object;
-  unsigned int element_buffer_object;
-
-  glGenVertexArrays(1, &vertex_array_object);
-  glGenBuffers(1, &vertex_buffer_object);
-  glGenBuffers(1, &element_buffer_object);
-
-  glBindVertexArray(vertex_array_object);
-  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_object);
-
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
-
-  unsigned int container;
-  unsigned int awesomeface;
-
-  glGenTextures(1, &container);
-  glGenTextures(1, &awesomeface);
+  unsigned int element_buffer_object {0};
+  VertexStreamBuffers vertex_stream_buffers {};
 
-  glBindTexture(GL_TEXTURE_2D, container);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // what the loop draws: a VAO, its index count and a model transform per instance
+  struct InstanceDraw {
+    unsigned int vertex_array;
+    int index_count;
+    std::array<float, 16> transform;
+  };
+  const std::array<float, 16> IDENTITY {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  std::vector<InstanceDraw> draws;
+
+  // the first instance's mesh: its VAO and index count for warm-up and benchmarks, and its
+  // vertices to find the texture coords (location 2) in
+  unsigned int vertex_array;
+  int index_count;
+  std::span<const float> quad_vertices;
+  size_t vertex_floats;
+  std::optional<size_t> uv_offset;
+  if (scene_geometry) {
+    const SceneMesh& mesh = scene.meshes()[scene.instances()[0].mesh];
+    vertex_array = scene_geometry->mesh(scene.instances()[0].mesh).vertex_array;
+    index_count = mesh.index_count;
+    quad_vertices = scene.vertices(mesh);
+    vertex_floats = mesh.stride / sizeof(float);
+    for (uint32_t i = 0, offset = 0; i < mesh.attribute_count; offset += mesh.attributes[i++].components) {
+      if (mesh.attributes[i].location == 2) {
+        uv_offset = offset;
+      }
+    }
+    for (const SceneInstance& instance : scene.instances()) {
+      if (instance.material == scene_material) {
+        InstanceDraw draw {scene_geometry->mesh(instance.mesh).vertex_array, (int)scene.meshes()[instance.mesh].index_count, {}};
+        std::copy_n(instance.transform, 16, draw.transform.begin());
+        draws.push_back(draw);
+      }
+    }
+    std::cout << "Scene: " << scene.meshes().size() << " meshes, " << scene.materials().size() << " materials, "
+              << scene.instances().size() << " instances (" << draws.size() << " drawn with the first one's material), "
+              << scene_geometry->uploaded_bytes() << " bytes uploaded in place" << std::endl;
+  }
+  else {
+    glGenBuffers(1, &element_buffer_object);
+
+    // only the attributes the program reads are uploaded; shader.fs ignores `our_color`, so `a_color` is dropped
+    VertexStream vertex_stream(vertices, sizeof(vertices), {
+      {0, 3}, // positions
+      {1, 3}, // colors
+      {2, 2}, // texture coords
+    });
+    vertex_stream_buffers = vertex_stream.build(shader, element_buffer_object);
+    std::cout << "Vertex stream: " << vertex_stream_buffers.source_stride << " -> " << vertex_stream_buffers.stride << " bytes per vertex, "
+              << vertex_stream_buffers.bytes_saved_per_draw << " bytes saved per draw" << std::endl;
+
+    // the element buffer binding is part of the VAO bound by build()
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    vertex_array = vertex_stream_buffers.vertex_array;
+    index_count = sizeof(indices) / sizeof(unsigned int);
+    quad_vertices = vertices;
+    vertex_floats = 8;
+    uv_offset = 6;
+    draws.push_back({vertex_array, index_count, IDENTITY});
+  }
+  glBindVertexArray(vertex_array);
+
+  if (warm_up) {
+    ShaderWarmup warmup;
+    warmup.add_program(shader);
+    warmup.add_vertex_format(vertex_array);
+    warmup.add_target_format(GL_RGBA8); // default framebuffer
+    std::cout << "Shader warm-up: " << warmup.run() << " ms" << std::endl;
+  }
+  end_phase("geometry and warm-up");
 
-  int width;
-  int height;
-  int number_of_color_channels;
+  // what each texture unit gets, in unit order: the material's textures, or the baked one
+  struct UnitBinding {
+    unsigned int texture;
+    std::string sampler;
+    SamplerDescription sampling;
+  };
+  std::vector<UnitBinding> units;
+  SamplerRegistry samplers;
+
+  state_cache.invalidate();
+
+  // each image gets the smallest internal format holding it; rows are flipped while converting
+  TextureFormatSelector formats;
+  // uploads queued while the loop runs are spread over frames
+  UploadScheduler uploads;
+  // only small mips are uploaded here, finer ones stream in once draws ask for them; fine
+  // levels of asset textures leave memory past its budget and are decoded again when needed
+  TextureStreaming streaming(uploads, 64 * 1024 * 1024, 32 * 1024 * 1024);
+  // identical image files are decoded once and share one texture
+  TextureCache textures;
+  ProceduralTextures procedural_textures;
+
+  // waits for the startup decode of `name` when it has not finished yet
+  auto decoded = [&](const std::string &name) {
+    DecodedImage image = take_decoded(name);
+    decodes_finished = std::max(decodes_finished.value_or(image.finished), image.finished);
+    return image;
+  };
 
-  stbi_set_flip_vertically_on_load(true);
+  auto load_texture = [&](const std::string &name) {
+    return textures.acquire(assets.get(name), [&](unsigned int texture) -> size_t {
+      DecodedImage image = decoded(name);
+      if (image.pixels.empty()) {
+        std::cout << "Failed to load `" << name << "` texture" << std::endl;
+        return 0;
+      }
+      TextureStreaming::Source source = [bytes = assets.get(name)](std::vector<TextureStreaming::Mip> &mips) {
+        return decode_mips(bytes.data, bytes.size, mips);
+      };
+      if (!streaming.add(texture, formats.select(image.pixels.data(), image.width, image.height, image.channels, {.flip = true}), source)) {
+        std::cout << "Failed to upload `" << name << "` texture" << std::endl;
+        return 0;
+      }
+      return image.pixels.size();
+    });
+  };
 
-  // container
-  unsigned char* data = stbi_load("../textures/container.jpg", &width, &height, &number_of_color_channels, 0);
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+  std::array<float, 4> uv_transform {};
+  if (blend) {
+    const MaterialTexture* first = &*find_texture(blend->first);
+    const MaterialTexture* second = &*find_texture(blend->second);
+
+    // the quad's texture coords bound the baked area
+    float uv_min[2] {0.0f, 0.0f};
+    float uv_max[2] {1.0f, 1.0f};
+    if (uv_offset && quad_vertices.size() >= vertex_floats) {
+      std::copy_n(&quad_vertices[*uv_offset], 2, uv_min);
+      std::copy_n(&quad_vertices[*uv_offset], 2, uv_max);
+      for (size_t i = *uv_offset; i < quad_vertices.size(); i += vertex_floats) {
+        uv_min[0] = std::min(uv_min[0], quad_vertices[i]);
+        uv_min[1] = std::min(uv_min[1], quad_vertices[i + 1]);
+        uv_max[0] = std::max(uv_max[0], quad_vertices[i]);
+        uv_max[1] = std::max(uv_max[1], quad_vertices[i + 1]);
+      }
+    }
+
+    // the baker wants both images as RGBA with the bottom row first, expanded the way
+    // stb_image does when asked for 4 channels
+    BakeSource sources[2] {};
+    std::vector<unsigned char> rgba[2];
+    for (int i = 0; i < 2; i++) {
+      const MaterialTexture* texture = i == 0 ? first : second;
+      DecodedImage image = decoded(texture->name);
+      BakeSource& source = sources[i];
+      if (!image.pixels.empty()) {
+        rgba[i].resize((size_t)image.width * image.height * 4);
+        for (size_t y = 0; y < (size_t)image.height; y++) {
+          const unsigned char* row = &image.pixels[(image.height - 1 - y) * image.width * image.channels];
+          for (size_t x = 0; x < (size_t)image.width; x++) {
+            const unsigned char* pixel = &row[x * image.channels];
+            unsigned char* destination = &rgba[i][(y * image.width + x) * 4];
+            bool gray = image.channels < 3;
+            destination[0] = pixel[0];
+            destination[1] = pixel[gray ? 0 : 1];
+            destination[2] = pixel[gray ? 0 : 2];
+            destination[3] = image.channels == 2 || image.channels == 4 ? pixel[image.channels - 1] : 255;
+          }
+        }
+        source.pixels = rgba[i].data();
+      }
+      source.width = image.width;
+      source.height = image.height;
+      source.wrap_s = texture->sampling.wrap_s;
+      source.wrap_t = texture->sampling.wrap_t;
+    }
+
+    if (sources[0].pixels && sources[1].pixels) {
+      BakedTexture baked = MaterialBaker().bake(sources[0], sources[1], blend->factor, uv_min, uv_max);
+      // wrapping was applied while baking, the baked texture only needs clamping
+      units.push_back({0, "baked", clamped});
+      glGenTextures(1, &units[0].texture);
+      if (!streaming.add(units[0].texture, formats.select(baked.pixels.data(), baked.width, baked.height, 4))) {
+        std::cout << "Failed to upload the baked texture" << std::endl;
+      }
+      std::copy_n(baked.uv_transform, 4, uv_transform.begin());
+      std::cout << "Baked `" << blend->first << "` and `" << blend->second << "` into one "
+                << baked.width << "x" << baked.height << " texture" << std::endl;
+    }
+    else {
+      std::cout << "Failed to load textures to bake" << std::endl;
+    }
   }
   else {
-    std::cout << "Failed to load `container` texture" << std::endl;
+    for (size_t i = 0; i < material.textures.size(); i++) {
+      const MaterialTexture& texture = material.textures[i];
+      units.push_back({0, texture.sampler, texture.sampling});
+      // `--procedural` replaces the first texture
+      if (procedural && i == 0) {
+        auto start = std::chrono::steady_clock::now();
+        units[i].texture = procedural_textures.get({ProceduralPattern::checker, 512, 512, {.55f, .35f, .15f, 1.0f}, {.3f, .18f, .07f, 1.0f}});
+        std::chrono::duration<double, std::milli> generation_time = std::chrono::steady_clock::now() - start;
+        std::cout << "Procedural textures: " << procedural_textures.size() << " generated in " << generation_time.count() << " ms" << std::endl;
+      }
+      else {
+        units[i].texture = load_texture(texture.name);
+      }
+    }
   }
-  stbi_image_free(data);
 
-  // awesomeface
-  glBindTexture(GL_TEXTURE_2D, awesomeface);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // GL_REPEAT is the default behaviour for textures
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // textures read from disk (ASSET_DIR or EMBED_ASSETS=OFF) are reloaded when edited; the
+  // baked texture is not, run with `--live-mix` to edit its sources
+  TextureReloader reloader([&](TextureReloader::Reload &reload) {
+    DecodedImage image = decode_image(reload.bytes.data(), reload.bytes.size());
+    if (image.pixels.empty()) {
+      return false;
+    }
+    reload.decoded = image.pixels.size();
+    reload.upload = TextureFormatSelector().select(image.pixels.data(), image.width, image.height, image.channels, {.flip = true});
+    // the GL thread only queues the levels
+    return TextureStreaming::build_mips(reload.upload, reload.mips);
+  });
+  if (!blend) {
+    for (size_t i = 0; i < units.size(); i++) {
+      std::string path = assets.file_path(material.textures[i].name);
+      if (units[i].texture != 0 && !path.empty() && !(procedural && i == 0)) {
+        reloader.watch(units[i].texture, path);
+      }
+    }
+  }
 
-  data = stbi_load("../textures/awesomeface.png", &width, &height, &number_of_color_channels, 0);
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+  // startup decodes no texture asked for, e.g. with `--procedural`, stop at their next hop
+  for (auto& [name, decode] : decodes) {
+    decode.task.cancel();
   }
-  else {
-    std::cout << "Failed to load `awesomeface` texture" << std::endl;
+
+  std::cout << "Texture cache: " << textures.size() << " unique textures, " << textures.deduplicated_bytes()
+            << " decoded bytes deduplicated" << std::endl;
+  std::cout << "Texture formats saved " << formats.bytes_saved() << " bytes compared to RGBA8" << std::endl;
+  DecodeArena::Statistics arena = DecodeArena::total_statistics();
+  std::cout << "Decode arenas (" << arena.arenas << " threads): " << arena.allocations << " allocations, " << arena.reallocations << " reallocations ("
+            << arena.in_place_reallocations << " in place), " << arena.heap_allocations << " heap blocks, peak "
+            << arena.peak_bytes << " bytes in one arena" << std::endl;
+  // the initial levels are small, they all go up before the first frame samples them
+  while (!uploads.idle()) {
+    uploads.drain();
   }
-  stbi_image_free(data);
+  end_phase("textures");
 
   // set uniforms
   shader.use();
-  shader.set_int("container", 0);
-  shader.set_int("awesomeface", 1);
+  if (blend) {
+    shader.set_float_sin("uv_transform", uv_transform.data());
+  }
+  for (size_t unit = 0; unit < units.size(); unit++) {
+    shader.set_int(units[unit].sampler, unit);
+    state_cache.bind_texture(unit, GL_TEXTURE_2D, units[unit].texture);
+    samplers.bind(unit, units[unit].sampling);
+  }
+
+  // `--fill-benchmark` times many overlapping quads, run it with and without `--live-mix`
+  if (has_flag(argc, argv, "--fill-benchmark")) {
+    std::cout << "Fill rate: " << fill_benchmark(shader, 1000, index_count) << " ms for 1000 quads ("
+              << (blend ? "baked" : "live mix") << ")" << std::endl;
+  }
+  // `--overdraw` compares the fragments a sprite shades as a full quad and as an alpha-trimmed mesh
+  if (has_flag(argc, argv, "--overdraw")) {
+    report_overdraw(shader, "textures/awesomeface.png");
+  }
+
+  // `--atlas-sprites` draws a strip of small sprites made from both images, packed into one
+  // atlas page so the whole strip is a single texture bind and draw; `--array-sprites` puts
+  // the images in layers of one texture array instead, picked by a layer in the vertices
+  const int SPRITE_SIZE = 128;
+  const int SPRITE_COUNT = 64;
+  bool atlas_sprites = has_flag(argc, argv, "--atlas-sprites");
+  bool array_sprites = !atlas_sprites && has_flag(argc, argv, "--array-sprites");
+  std::optional<Shader> sprite_shader;
+  TextureAtlas atlas(1024);
+  TextureArrays texture_arrays;
+  SpriteBatch sprites;
+  GLenum sprite_target = atlas_sprites ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY;
+  unsigned int sprite_texture {0};
+  if (atlas_sprites || array_sprites) {
+    // decoded and scaled down on the pool, added to the atlas or the array on the GL thread;
+    // slots keep the images in order whichever finishes first
+    const char* SPRITE_IMAGES[] {"textures/container.jpg", "textures/awesomeface.png"};
+    std::vector<std::optional<SpriteRegion>> slots(std::size(SPRITE_IMAGES));
+    std::vector<TaskHandle> loads;
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+      loads.push_back(tasks.spawn(load_sprite_image(tasks, SPRITE_IMAGES[slot], SPRITE_SIZE, [&, slot](const DecodedImage &image, const SpriteMesh &mesh) {
+        if (atlas_sprites) {
+          if (std::optional<AtlasRegion> region = atlas.add(image.pixels.data(), image.width, image.height, image.channels)) {
+            slots[slot] = {.u0 = region->u0, .v0 = region->v0, .u1 = region->u1, .v1 = region->v1, .layer = 0.0f, .mesh = mesh};
+          }
+        }
+        else {
+          // RGB and RGBA images share an RGBA8 array, the driver expands RGB rows
+          const GLenum FORMATS[] {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+          TextureLayer layer = texture_arrays.add(image.pixels.data(), image.width, image.height, FORMATS[image.channels - 1], GL_RGBA8);
+          slots[slot] = {.u0 = 0.0f, .v0 = 0.0f, .u1 = 1.0f, .v1 = 1.0f, .layer = (float)layer.layer, .mesh = mesh};
+          sprite_texture = layer.texture;
+        }
+      })));
+    }
+    for (const TaskHandle& load : loads) {
+      tasks.wait(load);
+    }
+    std::vector<SpriteRegion> regions;
+    for (const std::optional<SpriteRegion>& region : slots) {
+      if (region) {
+        regions.push_back(*region);
+      }
+    }
+    atlas.upload();
+    texture_arrays.generate_mips();
+    if (atlas_sprites && atlas.page_count()) {
+      // two small images always share the first page
+      sprite_texture = atlas.page_texture(0);
+    }
+    if (!regions.empty()) {
+      sprites = build_sprite_batch(regions, SPRITE_COUNT);
+      if (atlas_sprites) {
+        // shader_baked.fs samples one texture, with an identity transform it is a plain sprite shader
+        sprite_shader.emplace("src/shader.vs", "src/shader_baked.fs");
+        float identity[4] {1.0f, 1.0f, 0.0f, 0.0f};
+        sprite_shader->use();
+        sprite_shader->set_int("baked", 0);
+        sprite_shader->set_float_sin("uv_transform", identity);
+      }
+      else {
+        sprite_shader.emplace("src/shader_array.vs", "src/shader_array.fs");
+        sprite_shader->use();
+        sprite_shader->set_int("textures", 0);
+      }
+      float coverage = 0.0f;
+      for (const SpriteRegion& region : regions) {
+        coverage += region.mesh.coverage / regions.size();
+      }
+      std::cout << "Sprites: " << regions.size() << " images in one " << (atlas_sprites ? "atlas page" : "texture array") << ", "
+                << SPRITE_COUNT << " sprites in one draw, trimmed to " << coverage * 100.0f << "% of their quads" << std::endl;
+    }
+  }
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, container);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, awesomeface);
+  // `WORLD` names a directory of one-unit chunks (`scene_compiler --world` writes one) streamed
+  // in around a camera the arrow keys move
+  std::optional<WorldStreaming> world;
+  std::array<float, 4> camera {};
+  if (const char* world_directory = std::getenv("WORLD")) {
+    world.emplace(world_directory, shader, uploads, 1.0f, 1.5f, 2.5f);
+  }
 
   /* glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); does not fill the triangles */
 
+  bool first_frame = true;
+  auto first_frame_start = std::chrono::steady_clock::now();
+  auto last_frame = first_frame_start;
+
   while (!glfwWindowShouldClose(window)) {
     // input
     process_input(window);
+    auto now = std::chrono::steady_clock::now();
+    float frame_time = std::chrono::duration<float>(now - last_frame).count();
+    last_frame = now;
+    if (world) {
+      const float SPEED = 1.0f; // units per second
+      camera[0] += SPEED * frame_time * ((glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) - (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS));
+      camera[1] += SPEED * frame_time * ((glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) - (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS));
+      world->update(camera[0], camera[1]);
+    }
 
     // clearing
     glClearColor(.2f, .3f, .3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
+    // the quad spans half the framebuffer and repeats its textures twice; the baked texture covers it once
+    int framebuffer_width;
+    int framebuffer_height;
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+    float coverage = blend ? 2.0f : 4.0f;
+    for (const UnitBinding& unit : units) {
+      streaming.request(unit.texture, framebuffer_width / coverage, framebuffer_height / coverage);
+    }
+    reloader.update([&](TextureReloader::Reload &reload) {
+      TextureStreaming::Source source = [bytes = reload.bytes](std::vector<TextureStreaming::Mip> &mips) {
+        return decode_mips(bytes.data(), bytes.size(), mips);
+      };
+      if (streaming.add(reload.texture, reload.upload, std::move(reload.mips), source)) {
+        textures.refresh(reload.texture, std::move(reload.bytes), reload.decoded);
+        std::cout << "Reloaded `" << reload.path << "`" << std::endl;
+      }
+    });
+    streaming.update();
+    uploads.drain();
+    tasks.run_gl_thread();
+    if (!units.empty()) {
+      state_cache.bind_texture(0, GL_TEXTURE_2D, units[0].texture);
+    }
+
     // rendering
     shader.use();
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    if (world) {
+      shader.set_float_sin("camera", camera.data());
+    }
+    for (const InstanceDraw& draw : draws) {
+      glBindVertexArray(draw.vertex_array);
+      shader.set_mat4("model", draw.transform.data());
+      glDrawElements(GL_TRIANGLES, draw.index_count, GL_UNSIGNED_INT, 0);
+    }
+    glBindVertexArray(vertex_array);
+    if (world) {
+      // chunks are placed by their own vertices
+      shader.set_mat4("model", IDENTITY.data());
+      world->draw([](unsigned int chunk_vertex_array, int chunk_index_count) {
+        glBindVertexArray(chunk_vertex_array);
+        glDrawElements(GL_TRIANGLES, chunk_index_count, GL_UNSIGNED_INT, 0);
+      });
+      glBindVertexArray(vertex_array);
+    }
+    if (sprite_shader) {
+      sprite_shader->use();
+      state_cache.bind_texture(0, sprite_target, sprite_texture);
+      glBindVertexArray(sprites.vertex_array);
+      glDrawElements(GL_TRIANGLES, sprites.index_count, GL_UNSIGNED_INT, 0);
+      glBindVertexArray(vertex_array);
+    }
 
     // check and call events and swap the buffers
     glfwSwapBuffers(window);
     glfwPollEvents();
+
+    if (first_frame) {
+      glFinish();
+      first_frame = false;
+      std::chrono::duration<double, std::milli> first_frame_time = std::chrono::steady_clock::now() - first_frame_start;
+      std::cout << "First frame: " << first_frame_time.count() << " ms" << (warm_up ? "" : " (no warm-up)") << std::endl;
+
+      end_phase("first frame");
+      auto milliseconds = [&](std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration<double, std::milli>(time - process_start).count();
+      };
+      std::cout << "Time to first frame: " << milliseconds(phase_start) << " ms (";
+      for (size_t i = 0; i < startup_phases.size(); i++) {
+        std::cout << (i > 0 ? ", " : "") << startup_phases[i].first << " " << startup_phases[i].second;
+      }
+      std::cout << ")" << std::endl;
+      tasks.wait(preload);
+      std::cout << "Preloaded " << preloaded << " assets with " << (reader->using_io_uring() ? "io_uring" : "pread threads");
+      if (decodes_finished) {
+        std::cout << ", images decoded " << milliseconds(*decodes_finished) << " ms after start";
+      }
+      std::cout << std::endl;
+    }
   }
 
-  glDeleteVertexArrays(1, &vertex_array_object);
-  glDeleteVertexArrays(1, &vertex_buffer_object);
-  glDeleteBuffers(1, &element_buffer_object);
+  std::cout << "Texture streaming: " << streaming.resident_bytes() << " bytes on the GPU, " << streaming.memory_bytes()
+            << " bytes of levels in memory, " << streaming.rebuilt_chains() << " chains decoded again" << std::endl;
+  if (world) {
+    const WorldStreaming::Statistics& world_statistics = world->statistics();
+    std::cout << "World streaming: " << world_statistics.loads << " chunk loads, " << world_statistics.cancelled_loads << " cancelled, "
+              << world_statistics.evictions << " evictions, " << world_statistics.uploaded_bytes << " bytes uploaded, worst update "
+              << world_statistics.worst_update_ms << " ms" << std::endl;
+    world.reset();
+  }
+  if (sprite_shader) {
+    glDeleteVertexArrays(1, &sprites.vertex_array);
+    glDeleteBuffers(2, sprites.buffers);
+    sprite_shader.reset();
+  }
+  atlas.clear();
+  texture_arrays.clear();
+  if (scene_geometry) {
+    scene_geometry.reset();
+  }
+  else {
+    glDeleteVertexArrays(1, &vertex_stream_buffers.vertex_array);
+    glDeleteBuffers(1, &vertex_stream_buffers.vertex_buffer);
+    glDeleteBuffers(1, &element_buffer_object);
+  }
+  samplers.clear();
+  for (const UnitBinding& unit : units) {
+    textures.release(unit.texture);
+  }
+  procedural_textures.clear();
+  if (blend && !units.empty()) {
+    glDeleteTextures(1, &units[0].texture);
+  }
+  shader.clear();
 
   glfwTerminate();
   return 0;
@@ -168,3 +756,185 @@ void process_input(GLFWwindow* window) {
     glfwSetWindowShouldClose(window, true);
   }
 }
+
+bool has_flag(int argc, char* argv[], const char* flag) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], flag) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+double fill_benchmark(Shader &shader, int draws, int index_count) {
+  shader.use();
+  glFinish();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < draws; i++) {
+    glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+  }
+  glFinish();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report_overdraw(Shader &shader, const char* name) {
+  int width;
+  int height;
+  int channels;
+  Asset image = assets.get(name);
+  unsigned char* data = stbi_load_from_memory(image.data, image.size, &width, &height, &channels, 4);
+  if (!data) {
+    std::cout << "Failed to load `" << name << "` texture" << std::endl;
+    return;
+  }
+  SpriteMesh mesh = SpriteMeshGenerator().generate(data, width, height);
+  stbi_image_free(data);
+  decode_arena.reset();
+
+  SpriteMesh quad = SpriteMeshGenerator::quad();
+  int previous_vertex_array;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+  shader.use();
+
+  // same placement as the quad in main(): positions span [-.5, .5]
+  auto count = [](const SpriteMesh& sprite) {
+    std::vector<float> vertices;
+    for (size_t i = 0; i < sprite.vertices.size(); i += 2) {
+      vertices.insert(vertices.end(), {sprite.vertices[i] - .5f, sprite.vertices[i + 1] - .5f, .0f, sprite.vertices[i], sprite.vertices[i + 1]});
+    }
+    unsigned int vertex_array;
+    unsigned int buffers[2];
+    glGenVertexArrays(1, &vertex_array);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sprite.indices.size() * sizeof(unsigned int), sprite.indices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+
+    unsigned int fragments = SpriteMeshGenerator::count_fragments([&] {
+      glDrawElements(GL_TRIANGLES, sprite.indices.size(), GL_UNSIGNED_INT, 0);
+    });
+    glDeleteVertexArrays(1, &vertex_array);
+    glDeleteBuffers(2, buffers);
+    return fragments;
+  };
+  unsigned int before = count(quad);
+  unsigned int after = count(mesh);
+  glBindVertexArray(previous_vertex_array);
+
+  std::cout << "Overdraw of `" << name << "`: " << before << " fragments as a quad, " << after << " with a "
+            << mesh.vertices.size() / 2 << "-vertex trimmed mesh (" << mesh.coverage * 100.0f << "% of the quad)" << std::endl;
+}
+
+SpriteBatch build_sprite_batch(const std::vector<SpriteRegion> &regions, int count) {
+  // a strip along the bottom of the window; images are stored top row first, so the top
+  // edge of a sprite takes v0
+  const int COLUMNS = 16;
+  const float SIZE = .1f;
+  const float SPACING = .12f;
+  std::vector<float> vertices;
+  std::vector<unsigned int> indices;
+  for (int i = 0; i < count; i++) {
+    const SpriteRegion& region = regions[i % regions.size()];
+    float left = -.95f + (i % COLUMNS) * SPACING;
+    float bottom = -.95f + (i / COLUMNS) * SPACING;
+    unsigned int first = vertices.size() / 6;
+    // the trimmed outline instead of the full quad, so transparent corners are not rasterized;
+    // mesh coords are in the image, v = 1 at the top row
+    for (size_t vertex = 0; vertex < region.mesh.vertices.size(); vertex += 2) {
+      float u = region.mesh.vertices[vertex];
+      float v = region.mesh.vertices[vertex + 1];
+      vertices.insert(vertices.end(), {
+        left + u * SIZE, bottom + v * SIZE, .0f,
+        region.u0 + u * (region.u1 - region.u0), region.v1 + v * (region.v0 - region.v1),  region.layer,
+      });
+    }
+    for (unsigned int index : region.mesh.indices) {
+      indices.push_back(first + index);
+    }
+  }
+
+  SpriteBatch batch;
+  batch.index_count = indices.size();
+  int previous_vertex_array;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vertex_array);
+  glGenVertexArrays(1, &batch.vertex_array);
+  glGenBuffers(2, batch.buffers);
+  glBindVertexArray(batch.vertex_array);
+  glBindBuffer(GL_ARRAY_BUFFER, batch.buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.buffers[1]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(5 * sizeof(float)));
+  glEnableVertexAttribArray(3);
+  glBindVertexArray(previous_vertex_array);
+  return batch;
+}
+
+DecodedImage decode_image(const unsigned char* bytes, size_t size) {
+  DecodedImage image;
+  // the flip setting is per thread and left off; rows are flipped while converting formats
+  stbi_set_flip_vertically_on_load_thread(false);
+  unsigned char* data = stbi_load_from_memory(bytes, size, &image.width, &image.height, &image.channels, 0);
+  if (data) {
+    // the pixels are copied out (one heap allocation), the arena is rewound before the image is handed on
+    if (!ImageResampler(MAX_TEXTURE_SIZE).clamp(data, image.width, image.height, image.channels, image.pixels)) {
+      image.pixels.assign(data, data + (size_t)image.width * image.height * image.channels);
+    }
+    stbi_image_free(data);
+  }
+  decode_arena.reset();
+  image.finished = std::chrono::steady_clock::now();
+  return image;
+}
+
+bool decode_mips(const unsigned char* bytes, size_t size, std::vector<TextureStreaming::Mip> &mips) {
+  DecodedImage image = decode_image(bytes, size);
+  if (image.pixels.empty()) {
+    return false;
+  }
+  TextureUpload upload = TextureFormatSelector().select(image.pixels.data(), image.width, image.height, image.channels, {.flip = true});
+  return TextureStreaming::build_mips(upload, mips);
+}
+
+Task<> preload_assets(std::shared_ptr<AsyncReader> reader, std::vector<std::string> names, size_t &preloaded) {
+  // spawned, so this already runs on a worker
+  preloaded = assets.preload(*reader, names);
+  co_return;
+}
+
+Task<> decode_startup_image(AssetTasks &tasks, TaskHandle preload, std::string name, DecodedImage &image) {
+  // parked, not holding a worker, until the batch has the bytes in memory
+  co_await tasks.after(preload);
+  Asset bytes = co_await tasks.read(name);
+  image = co_await tasks.on_pool([&]() { return decode_image(bytes.data, bytes.size); });
+}
+
+Task<> load_sprite_image(AssetTasks &tasks, std::string name, int size, std::function<void(const DecodedImage &image, const SpriteMesh &mesh)> add) {
+  Asset bytes = co_await tasks.read(name);
+  SpriteMesh mesh;
+  DecodedImage image = co_await tasks.on_pool([&]() {
+    DecodedImage decoded = decode_image(bytes.data, bytes.size);
+    if (!decoded.pixels.empty()) {
+      decoded.pixels = ImageResampler().resample(decoded.pixels.data(), decoded.width, decoded.height, decoded.channels, size, size);
+      decoded.width = size;
+      decoded.height = size;
+      // trimmed at the size it is drawn from, so the outline matches the texels in the atlas or array
+      mesh = decoded.channels == 4 ? SpriteMeshGenerator().generate(decoded.pixels.data(), size, size) : SpriteMeshGenerator::quad();
+    }
+    return decoded;
+  });
+  if (image.pixels.empty()) {
+    co_return;
+  }
+  co_await tasks.on_gl_thread([&]() { add(image, mesh); });
+}
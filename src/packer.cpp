@@ -0,0 +1,192 @@
+#include <pack_archive.h>
+
+#include <sys/stat.h>
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <optional>
+#include <cstring>
+
+// function prototypes
+void evict_from_page_cache(const std::string &path);
+bool benchmark(const std::string &pack_path, const std::vector<std::string> &roots);
+std::string loose_path(const std::vector<std::string> &roots, const std::string &name);
+
+// packer [--lz4] <output> <root> <asset>... [--root <root> <asset>...]...
+// writes every asset, named by its path relative to the <root> before it, into one pack;
+// build outputs such as compiled scenes come from a second root
+// packer --benchmark <pack> <root> [--root <root>]...
+// compares reading every entry of the pack with reading the same files loose, each from
+// the first root holding it
+int main(int argc, char* argv[]) {
+  if (argc >= 4 && std::strcmp(argv[1], "--benchmark") == 0) {
+    std::vector<std::string> roots {argv[3]};
+    for (int i = 4; i + 1 < argc; i += 2) {
+      if (std::strcmp(argv[i], "--root") != 0) {
+        std::cout << "usage: packer --benchmark <pack> <root> [--root <root>]..." << std::endl;
+        return 1;
+      }
+      roots.push_back(argv[i + 1]);
+    }
+    return benchmark(argv[2], roots) ? 0 : 1;
+  }
+
+  int first = 1;
+  bool compress = false;
+  if (argc > 1 && std::strcmp(argv[1], "--lz4") == 0) {
+    compress = true;
+    first++;
+  }
+  if (argc - first < 2) {
+    std::cout << "usage: packer [--lz4] <output> <root> <asset>... [--root <root> <asset>...]..." << std::endl;
+    return 1;
+  }
+  std::string output = argv[first];
+  std::string root = argv[first + 1];
+
+  PackWriter writer;
+  size_t total = 0;
+  int count = 0;
+  for (int i = first + 2; i < argc; i++) {
+    if (std::strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+      root = argv[++i];
+      continue;
+    }
+    std::ifstream file(root + "/" + argv[i], std::ios::binary);
+    if (!file) {
+      std::cout << "Failed to read `" << argv[i] << "`" << std::endl;
+      return 1;
+    }
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), {});
+    total += bytes.size();
+    writer.add(argv[i], std::move(bytes), compress);
+    count++;
+  }
+  if (!writer.write(output)) {
+    std::cout << "Failed to write `" << output << "`" << std::endl;
+    return 1;
+  }
+  std::cout << "Packed " << count << " assets (" << total << " bytes) into " << output << std::endl;
+  return 0;
+}
+
+void evict_from_page_cache(const std::string &path) {
+  int descriptor = open(path.c_str(), O_RDONLY);
+  if (descriptor != -1) {
+    // only clean pages that no process maps are dropped
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+    close(descriptor);
+  }
+}
+
+std::string loose_path(const std::vector<std::string> &roots, const std::string &name) {
+  for (const std::string& root : roots) {
+    struct stat status;
+    std::string path = root + "/" + name;
+    if (stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+      return path;
+    }
+  }
+  return {};
+}
+
+bool benchmark(const std::string &pack_path, const std::vector<std::string> &roots) {
+  PackArchive pack;
+  if (!pack.open(pack_path)) {
+    return false;
+  }
+  // both sides read the same entries: those with no loose file in any root are left out
+  std::vector<std::string> names;
+  std::vector<std::string> paths;
+  std::vector<std::vector<unsigned char>> staging;
+  size_t total = 0;
+  for (std::string_view name : pack.entry_names()) {
+    std::string path = loose_path(roots, std::string(name));
+    if (path.empty()) {
+      std::cout << "Skipping `" << name << "`, it is in no root" << std::endl;
+      continue;
+    }
+    names.emplace_back(name);
+    paths.push_back(path);
+    staging.emplace_back(*pack.entry_size(name));
+    total += staging.back().size();
+  }
+  pack.close();
+  if (names.empty()) {
+    std::cout << "Nothing to compare" << std::endl;
+    return false;
+  }
+
+  const int WARM_RUNS = 20;
+  // a failed read stops the benchmark, a rate over bytes never delivered means nothing
+  auto read_pack = [&]() {
+    if (!pack.open(pack_path)) {
+      return false;
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+      if (!pack.read(names[i], staging[i].data())) {
+        std::cout << "Failed to read `" << names[i] << "` from the pack" << std::endl;
+        pack.close();
+        return false;
+      }
+    }
+    pack.close();
+    return true;
+  };
+  auto read_loose = [&]() {
+    for (size_t i = 0; i < names.size(); i++) {
+      int descriptor = open(paths[i].c_str(), O_RDONLY);
+      if (descriptor == -1) {
+        std::cout << "Failed to open `" << paths[i] << "`" << std::endl;
+        return false;
+      }
+      size_t done = 0;
+      for (ssize_t count = 1; done < staging[i].size() && count > 0; done += std::max<ssize_t>(count, 0)) {
+        count = pread(descriptor, staging[i].data() + done, staging[i].size() - done, done);
+      }
+      close(descriptor);
+      if (done != staging[i].size()) {
+        std::cout << "Short read of `" << paths[i] << "`: " << done << " of " << staging[i].size() << " bytes" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  };
+  auto evict_loose = [&]() {
+    for (const std::string& path : paths) {
+      evict_from_page_cache(path);
+    }
+  };
+  // effective MB/s of decompressed bytes delivered into the staging buffers, none when a read fails
+  auto measure = [&](auto read, auto evict, int runs) -> std::optional<double> {
+    double seconds = 0.0;
+    for (int run = 0; run < runs; run++) {
+      evict();
+      auto start = std::chrono::steady_clock::now();
+      if (!read()) {
+        return std::nullopt;
+      }
+      seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return total * runs / seconds / (1024 * 1024);
+  };
+
+  auto nothing = []() {};
+  auto evict_pack = [&]() { evict_from_page_cache(pack_path); };
+  std::cout << names.size() << " entries, " << total << " bytes, " << job_pool.size() + 1 << " decompression threads" << std::endl;
+  std::optional<double> pack_cold = measure(read_pack, evict_pack, 1);
+  std::optional<double> pack_warm = pack_cold ? measure(read_pack, nothing, WARM_RUNS) : std::nullopt;
+  if (!pack_warm) {
+    return false;
+  }
+  std::cout << "pack (LZ4 blocks)  cold: " << *pack_cold << " MB/s, warm: " << *pack_warm << " MB/s" << std::endl;
+  std::optional<double> loose_cold = measure(read_loose, evict_loose, 1);
+  std::optional<double> loose_warm = loose_cold ? measure(read_loose, nothing, WARM_RUNS) : std::nullopt;
+  if (!loose_warm) {
+    return false;
+  }
+  std::cout << "loose files (raw)  cold: " << *loose_cold << " MB/s, warm: " << *loose_warm << " MB/s" << std::endl;
+  return true;
+}
@@ -0,0 +1,53 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 uv;
+
+uniform int pattern;   // 0 checker, 1 gradient, 2 noise
+uniform vec4 color_a;
+uniform vec4 color_b;
+uniform float scale;   // checker cells or noise lattice cells across the texture, whole numbers tile
+uniform int octaves;
+uniform float seed;
+
+float hash(vec2 cell) {
+  return fract(sin(dot(cell, vec2(127.1f, 311.7f)) + seed) * 43758.5453f);
+}
+
+// value noise on a lattice that wraps every `period` cells, so the texture tiles
+float noise(vec2 position, float period) {
+  vec2 cell = floor(position);
+  vec2 f = fract(position);
+  vec2 blend = f * f * (3.0f - 2.0f * f);
+  float a = hash(mod(cell, period));
+  float b = hash(mod(cell + vec2(1.0f, 0.0f), period));
+  float c = hash(mod(cell + vec2(0.0f, 1.0f), period));
+  float d = hash(mod(cell + vec2(1.0f, 1.0f), period));
+  return mix(mix(a, b, blend.x), mix(c, d, blend.x), blend.y);
+}
+
+void main() {
+  float t;
+  if (pattern == 0) {
+    vec2 cell = floor(uv * scale);
+    t = mod(cell.x + cell.y, 2.0f);
+  }
+  else if (pattern == 1) {
+    t = uv.y;
+  }
+  else {
+    // fractal sum, each octave doubles the frequency and halves the amplitude
+    float amplitude = 0.5f;
+    float period = scale;
+    float total = 0.0f;
+    t = 0.0f;
+    for (int octave = 0; octave < octaves; octave++) {
+      t += noise(uv * period, period) * amplitude;
+      total += amplitude;
+      amplitude *= 0.5f;
+      period *= 2.0f;
+    }
+    t /= total;
+  }
+  frag_color = mix(color_a, color_b, t);
+}
@@ -0,0 +1,9 @@
+#version 330 core
+out vec2 uv;
+
+void main() {
+  // one triangle covering the whole target, no vertex buffer needed
+  vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  uv = corner;
+  gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
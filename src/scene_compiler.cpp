@@ -0,0 +1,307 @@
+#include <glad/glad.h>
+#include <scene_file.h>
+#include <shader_reflection.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <optional>
+#include <cstring>
+#include <filesystem>
+
+// function prototypes
+bool compile(std::istream &input, SceneWriter &writer);
+std::optional<uint32_t> parse_wrap(const std::string &wrap);
+std::vector<uint32_t> unread_locations(const std::string &vertex_shader, const std::string &fragment_shader);
+bool write_world(const std::string &directory, int chunks);
+
+// scene_compiler <input> <output>
+// compiles a text scene (see scenes/quad.scene for the syntax) into the binary layout of scene_file.h
+// scene_compiler --world <directory> <chunks>
+// writes a test world of <chunks> x <chunks> tiled chunks for WorldStreaming, one unit each
+int main(int argc, char* argv[]) {
+  if (argc == 4 && std::strcmp(argv[1], "--world") == 0) {
+    return write_world(argv[2], std::stoi(argv[3])) ? 0 : 1;
+  }
+  if (argc != 3) {
+    std::cout << "usage: scene_compiler <input> <output>" << std::endl;
+    std::cout << "       scene_compiler --world <directory> <chunks>" << std::endl;
+    return 1;
+  }
+  std::ifstream input(argv[1]);
+  if (!input) {
+    std::cout << "Failed to read `" << argv[1] << "`" << std::endl;
+    return 1;
+  }
+  SceneWriter writer;
+  if (!compile(input, writer)) {
+    std::cout << "Failed to compile `" << argv[1] << "`" << std::endl;
+    return 1;
+  }
+  if (!writer.write(argv[2])) {
+    std::cout << "Failed to write `" << argv[2] << "`" << std::endl;
+    return 1;
+  }
+  std::cout << "Compiled " << argv[1] << " into " << argv[2] << std::endl;
+  return 0;
+}
+
+bool compile(std::istream &input, SceneWriter &writer) {
+  // the mesh being read is added once the next block starts, when all its lines are known
+  struct PendingMesh {
+    std::string name;
+    std::vector<SceneAttribute> attributes {};
+    std::vector<float> vertices {};
+    std::vector<uint32_t> indices {};
+    uint32_t components {0};
+  };
+  std::optional<PendingMesh> mesh;
+  std::map<std::string, uint32_t> meshes;
+  std::map<std::string, uint32_t> materials;
+  std::vector<std::pair<std::string, std::string>> material_shaders;
+  // the materials every mesh is drawn with, SCENE_NONE for the app's default one
+  std::map<uint32_t, std::set<uint32_t>> mesh_materials;
+  std::optional<uint32_t> material;
+  int line_number = 0;
+
+  auto fail = [&](const std::string &reason) {
+    std::cout << "ERROR::SCENE_COMPILER::LINE_" << line_number << " " << reason << std::endl;
+    return false;
+  };
+  auto finish_mesh = [&]() {
+    if (!mesh) {
+      return true;
+    }
+    uint32_t index = writer.add_mesh(mesh->name, mesh->attributes, std::move(mesh->vertices), std::move(mesh->indices));
+    if (index == SCENE_NONE) {
+      return false;
+    }
+    meshes[mesh->name] = index;
+    mesh.reset();
+    return true;
+  };
+
+  for (std::string line; std::getline(input, line);) {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string keyword;
+    if (!(words >> keyword)) {
+      continue;
+    }
+
+    if (keyword == "mesh" || keyword == "material" || keyword == "instance") {
+      if (!finish_mesh()) {
+        return fail("invalid mesh");
+      }
+      material.reset();
+    }
+
+    if (keyword == "mesh") {
+      std::string name;
+      if (!(words >> name) || meshes.count(name)) {
+        return fail("expected a new mesh name");
+      }
+      mesh = PendingMesh {name};
+    }
+    else if (keyword == "attribute" || keyword == "vertex" || keyword == "index") {
+      if (!mesh) {
+        return fail(keyword + " outside a mesh");
+      }
+      if (keyword == "attribute") {
+        SceneAttribute attribute;
+        if (!(words >> attribute.location >> attribute.components) || !mesh->vertices.empty()) {
+          return fail("expected <location> <floats> before the first vertex");
+        }
+        mesh->attributes.push_back(attribute);
+        mesh->components += attribute.components;
+      }
+      else if (keyword == "vertex") {
+        size_t count = 0;
+        for (float value; words >> value; count++) {
+          mesh->vertices.push_back(value);
+        }
+        if (count != mesh->components || !words.eof()) {
+          return fail("expected " + std::to_string(mesh->components) + " floats");
+        }
+      }
+      else {
+        for (uint32_t index; words >> index;) {
+          mesh->indices.push_back(index);
+        }
+        if (!words.eof()) {
+          return fail("expected indices");
+        }
+      }
+    }
+    else if (keyword == "material") {
+      std::string name;
+      std::string vertex_shader;
+      std::string fragment_shader;
+      if (!(words >> name >> vertex_shader >> fragment_shader) || materials.count(name)) {
+        return fail("expected a new material name and two shaders");
+      }
+      material = materials[name] = writer.add_material(name, vertex_shader, fragment_shader);
+      material_shaders.push_back({vertex_shader, fragment_shader});
+    }
+    else if (keyword == "texture") {
+      std::string sampler;
+      std::string asset;
+      std::string wrap_s;
+      std::string wrap_t;
+      if (!material) {
+        return fail("texture outside a material");
+      }
+      if (!(words >> sampler >> asset >> wrap_s >> wrap_t) || !parse_wrap(wrap_s) || !parse_wrap(wrap_t)) {
+        return fail("expected <sampler> <asset> <wrap s> <wrap t>");
+      }
+      writer.add_texture(*material, sampler, asset, *parse_wrap(wrap_s), *parse_wrap(wrap_t));
+    }
+    else if (keyword == "instance") {
+      std::string mesh_name;
+      std::string material_name;
+      if (!(words >> mesh_name >> material_name) || !meshes.count(mesh_name) || (material_name != "-" && !materials.count(material_name))) {
+        return fail("expected a defined mesh and material");
+      }
+      float transform[16] {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+      for (std::string operation; words >> operation;) {
+        float x;
+        float y;
+        float z;
+        if (!(words >> x >> y >> z) || (operation != "translate" && operation != "scale")) {
+          return fail("expected translate or scale and three floats");
+        }
+        if (operation == "translate") {
+          transform[12] += x;
+          transform[13] += y;
+          transform[14] += z;
+        }
+        else {
+          for (int column = 0; column < 4; column++) {
+            transform[column * 4] *= x;
+            transform[column * 4 + 1] *= y;
+            transform[column * 4 + 2] *= z;
+          }
+        }
+      }
+      uint32_t instance_material = material_name == "-" ? SCENE_NONE : materials[material_name];
+      writer.add_instance(meshes[mesh_name], instance_material, transform);
+      mesh_materials[meshes[mesh_name]].insert(instance_material);
+    }
+    else {
+      return fail("unknown keyword " + keyword);
+    }
+  }
+  if (!finish_mesh()) {
+    return fail("invalid mesh");
+  }
+
+  // the app uploads vertex sections as they are, so attributes that no material drawing a
+  // mesh reads are dropped here rather than carried through every draw
+  size_t saved = 0;
+  for (const auto& [mesh_index, mesh_material_indices] : mesh_materials) {
+    std::optional<std::vector<uint32_t>> unread;
+    for (uint32_t material_index : mesh_material_indices) {
+      std::vector<uint32_t> locations;
+      if (material_index != SCENE_NONE) {
+        locations = unread_locations(material_shaders[material_index].first, material_shaders[material_index].second);
+      }
+      if (unread) {
+        std::erase_if(*unread, [&](uint32_t location) { return std::find(locations.begin(), locations.end(), location) == locations.end(); });
+      }
+      else {
+        unread = locations;
+      }
+    }
+    saved += writer.strip_attributes(mesh_index, *unread);
+  }
+  if (saved) {
+    std::cout << "Stripped " << saved << " bytes of vertex attributes no material reads" << std::endl;
+  }
+  return true;
+}
+
+std::optional<uint32_t> parse_wrap(const std::string &wrap) {
+  if (wrap == "repeat") {
+    return GL_REPEAT;
+  }
+  if (wrap == "mirror") {
+    return GL_MIRRORED_REPEAT;
+  }
+  if (wrap == "clamp") {
+    return GL_CLAMP_TO_EDGE;
+  }
+  return std::nullopt;
+}
+
+std::vector<uint32_t> unread_locations(const std::string &vertex_shader, const std::string &fragment_shader) {
+  // shader paths are asset names, relative to the source root the build runs the compiler in
+  std::ifstream vertex_file(vertex_shader);
+  std::ifstream fragment_file(fragment_shader);
+  if (!vertex_file || !fragment_file) {
+    std::cout << "Keeping every attribute of the material using `" << vertex_shader << "` and `" << fragment_shader
+              << "`, they cannot be read" << std::endl;
+    return {};
+  }
+  std::stringstream vertex_source;
+  std::stringstream fragment_source;
+  vertex_source << vertex_file.rdbuf();
+  fragment_source << fragment_file.rdbuf();
+
+  std::set<std::string> unread = ShaderReflection::unread_inputs(vertex_source.str(), fragment_source.str());
+  std::vector<uint32_t> locations;
+  for (const auto& [name, location] : ShaderReflection::attribute_locations(vertex_source.str())) {
+    if (unread.count(name)) {
+      locations.push_back(location);
+    }
+  }
+  return locations;
+}
+
+bool write_world(const std::string &directory, int chunks) {
+  // every chunk is a grid of small quads with gaps between them, laid out like the quad
+  // in scenes/quad.scene: positions, colors, texture coords
+  const int TILES = 16;
+  const float TILE = 1.0f / TILES;
+  const float GAP = TILE / 8;
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  for (int chunk_x = 0; chunk_x < chunks; chunk_x++) {
+    for (int chunk_y = 0; chunk_y < chunks; chunk_y++) {
+      std::vector<float> vertices;
+      std::vector<uint32_t> indices;
+      for (int tile_x = 0; tile_x < TILES; tile_x++) {
+        for (int tile_y = 0; tile_y < TILES; tile_y++) {
+          float left = chunk_x + tile_x * TILE + GAP;
+          float bottom = chunk_y + tile_y * TILE + GAP;
+          float right = left + TILE - 2 * GAP;
+          float top = bottom + TILE - 2 * GAP;
+          float red = (float)tile_x / TILES;
+          float green = (float)tile_y / TILES;
+          uint32_t first = vertices.size() / 8;
+          vertices.insert(vertices.end(), {
+            right, top, .0f,     red, green, 1.0f,  1.0f, 1.0f,
+            right, bottom, .0f,  red, green, 1.0f,  1.0f, .0f,
+            left, bottom, .0f,   red, green, 1.0f,  .0f, .0f,
+            left, top, .0f,      red, green, 1.0f,  .0f, 1.0f,
+          });
+          indices.insert(indices.end(), {first, first + 1, first + 3, first + 1, first + 2, first + 3});
+        }
+      }
+      SceneWriter writer;
+      float identity[16] {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+      writer.add_instance(writer.add_mesh("tiles", {{0, 3}, {1, 3}, {2, 2}}, std::move(vertices), std::move(indices)), SCENE_NONE, identity);
+      std::string path = directory + "/chunk_" + std::to_string(chunk_x) + "_" + std::to_string(chunk_y) + ".scn";
+      if (!writer.write(path)) {
+        std::cout << "Failed to write `" << path << "`" << std::endl;
+        return false;
+      }
+    }
+  }
+  std::cout << "Wrote a world of " << chunks << "x" << chunks << " chunks into " << directory << std::endl;
+  return true;
+}
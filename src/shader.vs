@@ -6,8 +6,13 @@ layout (location = 2) in vec2 texture_coords;
 out vec2 tex_coord;
 out vec3 our_color;
 
+// xy: the camera's position in the streamed world, zero unless WORLD is set
+uniform vec4 camera;
+// where a scene instance goes, draws that never set it are not moved
+uniform mat4 model = mat4(1.0f);
+
 void main() {
-  gl_Position = vec4(apos, 1.0f);
+  gl_Position = model * vec4(apos, 1.0f) - vec4(camera.xy, .0f, .0f);
   our_color = a_color;
   tex_coord = texture_coords;
 }
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 tex_coord;
+flat in float layer;
+
+uniform sampler2DArray textures;
+
+void main() {
+  // the layer comes from the vertex data, so switching textures needs no rebind
+  frag_color = texture(textures, vec3(tex_coord, layer));
+}
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 apos;
+layout (location = 2) in vec2 texture_coords;
+layout (location = 3) in float texture_layer;
+
+out vec2 tex_coord;
+flat out float layer;
+
+void main() {
+  gl_Position = vec4(apos, 1.0f);
+  tex_coord = texture_coords;
+  layer = texture_layer;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 tex_coord;
+
+uniform sampler2D baked;
+uniform vec4 uv_transform;
+
+void main() {
+  // the textures shader.fs mixes, pre-composited at load over the quad's texture coords
+  frag_color = texture(baked, tex_coord * uv_transform.xy + uv_transform.zw);
+}